@@ -21,74 +21,344 @@
 #include <stdlib.h>
 #include <gtk/gtk.h>
 #include <gdk/gdk.h>
+#include <stdint.h>
 #include <glib.h>
+#ifdef GDK_WINDOWING_X11
+#include <gdk/gdkx.h>
+#include <X11/Xlib.h>
+#include <X11/extensions/XShm.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#endif
 
 #include "capture.h"
+#include "pixel_convert.h"
+
+/* Frames the capture window is kept for after the selection, so that the
+	compositor has shown it without the rubberband */
+#define CAPTURE_HIDE_FRAMES 2
+/* Milliseconds after which the selection is read even if the capture window
+	got no frames, e.g. because the display does not report them, and that
+	are waited without a compositor for the windows below the rubberband to
+	repaint themselves */
+#define CAPTURE_HIDE_TIMEOUT 100
 
 /*  Code for capture taken from gnome-screenshot
 	https://git.gnome.org/browse/gnome-screenshot */
 typedef struct {
 	gboolean aborted;
 	gboolean button_pressed;
+	gboolean selected;
+	gint64 selected_time;
+	int frames;
+	guint timeout_id;
 	GdkRectangle rect;
 	GdkCursor *cursor;
-	GdkPixbuf *pixbuf;
 	GtkWidget *window;
-	void (*callback)(GdkPixbuf *, gpointer);
+	/* The screen shown while selecting and its scale factor, or NULL if the
+		rubberband is shown over the live screen */
+	GdkPixbuf *frame;
+	cairo_surface_t *frame_surface;
+	int scale;
+	/* The rubberband on the frozen screen */
+	GdkRectangle drawn;
+	void (*callback)(GdkPixbuf *, const GdkRectangle *, gpointer);
 	gpointer cb_data;
 } capture_data;
 
-static gboolean capture_crop_pixbuf(gpointer pdata) {
+struct capture_Watch {
+	GdkRectangle rect;
+	guint source_id;
+	/* The capture read last and the one handed over last or NULL */
+	GdkPixbuf *read;
+	GdkPixbuf *delivered;
+	/* The number of reads in a row that read was the same for */
+	int stable;
+	void (*callback)(GdkPixbuf *, const GdkRectangle *, gpointer);
+	gpointer cb_data;
+};
+
+#ifdef GDK_WINDOWING_X11
+/* The shared memory the X server copies the screen into. It is kept for the
+	next capture and only replaced if that is larger. */
+typedef struct {
+	XShmSegmentInfo info;
+	size_t size;
+	GdkDisplay *display;
+} Shm_segment;
+
+static Shm_segment shm_segment;
+
+static void shm_segment_release(void) {
+	if (shm_segment.size == 0)
+		return;
+	XShmDetach(gdk_x11_display_get_xdisplay(shm_segment.display),
+		&shm_segment.info);
+	shmdt(shm_segment.info.shmaddr);
+	shm_segment.size = 0;
+}
+
+/** Makes sure the shared memory holds at least size bytes and is attached to
+	display. Returns 0 on failure, e.g. for a remote display.
+*/
+static int shm_segment_reserve(GdkDisplay *display, size_t size) {
+	Display *xdisplay = gdk_x11_display_get_xdisplay(display);
+	int failed;
+	
+	if (shm_segment.size >= size && shm_segment.display == display)
+		return 1;
+	shm_segment_release();
+	
+	if ((shm_segment.info.shmid = shmget(IPC_PRIVATE, size,
+		IPC_CREAT | 0600)) < 0)
+		return 0;
+	shm_segment.info.shmaddr = shmat(shm_segment.info.shmid, NULL, 0);
+	shm_segment.info.readOnly = False;
+	if (shm_segment.info.shmaddr == (char*)-1) {
+		shmctl(shm_segment.info.shmid, IPC_RMID, NULL);
+		return 0;
+	}
+	gdk_x11_display_error_trap_push(display);
+	XShmAttach(xdisplay, &shm_segment.info);
+	XSync(xdisplay, False);
+	failed = gdk_x11_display_error_trap_pop(display);
+	/* The segment is freed once both sides have detached */
+	shmctl(shm_segment.info.shmid, IPC_RMID, NULL);
+	if (failed) {
+		shmdt(shm_segment.info.shmaddr);
+		return 0;
+	}
+	shm_segment.size = size;
+	shm_segment.display = display;
+	return 1;
+}
+
+/** Copies the part area of the root window, in device pixels, into a new
+	pixbuf through shared memory. Returns NULL if the display does not
+	support it or has an unusual pixel format.
+*/
+static GdkPixbuf *grab_shm(GdkDisplay *display, const GdkRectangle *area) {
+	Display *xdisplay;
+	XImage *image;
+	GdkPixbuf *pixbuf = NULL;
+	guchar *pixels;
+	int screen, rowstride, y, failed;
+	
+	if (!GDK_IS_X11_DISPLAY(display))
+		return NULL;
+	xdisplay = gdk_x11_display_get_xdisplay(display);
+	if (!XShmQueryExtension(xdisplay))
+		return NULL;
+	screen = DefaultScreen(xdisplay);
+	image = XShmCreateImage(xdisplay, DefaultVisual(xdisplay, screen),
+		DefaultDepth(xdisplay, screen), ZPixmap, NULL, &shm_segment.info,
+		area->width, area->height);
+	if (image == NULL)
+		return NULL;
+	/* Only the common 32 bit pixels in the byte order of this machine are
+		read */
+	if (image->bits_per_pixel != 32 || image->red_mask != 0xff0000
+		|| image->green_mask != 0xff00 || image->blue_mask != 0xff
+		|| image->byte_order != (G_BYTE_ORDER == G_LITTLE_ENDIAN ? LSBFirst
+		: MSBFirst)
+		|| !shm_segment_reserve(display,
+		(size_t)image->bytes_per_line * image->height)) {
+		
+		XDestroyImage(image);
+		return NULL;
+	}
+	
+	image->data = shm_segment.info.shmaddr;
+	gdk_x11_display_error_trap_push(display);
+	XShmGetImage(xdisplay, RootWindow(xdisplay, screen), image, area->x,
+		area->y, AllPlanes);
+	failed = gdk_x11_display_error_trap_pop(display);
+	if (!failed) {
+		pixbuf = gdk_pixbuf_new(GDK_COLORSPACE_RGB, FALSE, 8, area->width,
+			area->height);
+		pixels = gdk_pixbuf_get_pixels(pixbuf);
+		rowstride = gdk_pixbuf_get_rowstride(pixbuf);
+		for (y = 0; y < area->height; y++)
+			pixel_convert_row_xrgb((const uint32_t*)(image->data
+				+ y * image->bytes_per_line), pixels + y * rowstride,
+				area->width);
+	}
+	/* The data belongs to the segment */
+	image->data = NULL;
+	XDestroyImage(image);
+	return pixbuf;
+}
+#endif
+
+GdkPixbuf *capture_area(const GdkRectangle *rect) {
+	GdkWindow *root = gdk_get_default_root_window();
+	GdkRectangle area = {0, 0, 0, 0};
+	GdkPixbuf *pixbuf = NULL;
+	int scale;
+	
+	area.width = gdk_window_get_width(root);
+	area.height = gdk_window_get_height(root);
+	if (!gdk_rectangle_intersect(rect, &area, &area))
+		return NULL;
+#ifdef GDK_WINDOWING_X11
+	scale = gdk_window_get_scale_factor(root);
+	area.x *= scale;
+	area.y *= scale;
+	area.width *= scale;
+	area.height *= scale;
+	pixbuf = grab_shm(gdk_window_get_display(root), &area);
+	area.x /= scale;
+	area.y /= scale;
+	area.width /= scale;
+	area.height /= scale;
+#else
+	(void)scale;
+#endif
+	if (pixbuf == NULL)
+		pixbuf = gdk_pixbuf_get_from_window(root, area.x, area.y, area.width,
+			area.height);
+	return pixbuf;
+}
+
+static void capture_data_free(capture_data *data) {
+	if (data->frame_surface != NULL)
+		cairo_surface_destroy(data->frame_surface);
+	if (data->frame != NULL)
+		g_object_unref(data->frame);
+	free(data);
+}
+
+/** Copies the selection out of the frozen screen. Returns NULL if it is off
+	the screen.
+*/
+static GdkPixbuf *frame_crop(capture_data *data) {
+	GdkRectangle area, frame_area = {0, 0, 0, 0};
+	GdkPixbuf *sub, *pixbuf;
+	
+	area.x = data->rect.x * data->scale;
+	area.y = data->rect.y * data->scale;
+	area.width = data->rect.width * data->scale;
+	area.height = data->rect.height * data->scale;
+	frame_area.width = gdk_pixbuf_get_width(data->frame);
+	frame_area.height = gdk_pixbuf_get_height(data->frame);
+	if (!gdk_rectangle_intersect(&area, &frame_area, &area))
+		return NULL;
+	/* A copy, so that the frame is not kept while the text is recognized */
+	sub = gdk_pixbuf_new_subpixbuf(data->frame, area.x, area.y, area.width,
+		area.height);
+	pixbuf = gdk_pixbuf_copy(sub);
+	g_object_unref(sub);
+	return pixbuf;
+}
+
+static gboolean capture_deliver(gpointer pdata) {
 	capture_data *data;
-	GdkPixbuf *cropped_pixbuf, * captured_pixbuf;
+	GdkPixbuf *pixbuf;
+	gint64 start;
 
 	data = (capture_data *) pdata;
-	captured_pixbuf = data->pixbuf;
-	cropped_pixbuf = gdk_pixbuf_new(gdk_pixbuf_get_colorspace(captured_pixbuf),
-	                                gdk_pixbuf_get_has_alpha(captured_pixbuf),
-	                                gdk_pixbuf_get_bits_per_sample(
-	                                    captured_pixbuf),
-	                                data->rect.width, data->rect.height);
-	/*  Takes a part of the screenshot that was made right after the mouse
-		button was pressed. This isn't optimal but otherwise it is possible for
-		the rubberband to appear on the capture. */
-	gdk_pixbuf_copy_area(captured_pixbuf, data->rect.x,
-	                     data->rect.y, data->rect.width, data->rect.height,
-	                     cropped_pixbuf, 0, 0);
-
-	g_object_unref(captured_pixbuf);
-	data->callback(cropped_pixbuf, data->cb_data);
-
-	g_object_unref(cropped_pixbuf);
-	free(data);
+	if (data->timeout_id != 0)
+		g_source_remove(data->timeout_id);
+	/*  The selection is only read once the rubberband is gone from the
+		screen, so that it cannot appear on the capture, and only the
+		selected part of the screen is copied. A frozen screen has no
+		rubberband on it. */
+	start = g_get_monotonic_time();
+	if (data->frame != NULL)
+		pixbuf = frame_crop(data);
+	else
+		pixbuf = capture_area(&data->rect);
+	g_debug("capture: read %dx%d pixels in %.1f ms, %.1f ms after the "
+		"selection", data->rect.width, data->rect.height,
+		(g_get_monotonic_time() - start) / 1000.0,
+		(start - data->selected_time) / 1000.0);
+	gtk_widget_destroy(data->window);
+	data->callback(pixbuf, pixbuf != NULL ? &data->rect : NULL,
+		data->cb_data);
+
+	if (pixbuf != NULL)
+		g_object_unref(pixbuf);
+	capture_data_free(data);
 
 	return FALSE;
 }
 
+static gboolean capture_hide_timeout(gpointer pdata) {
+	capture_data *data = (capture_data *) pdata;
+
+	data->timeout_id = 0;
+	return capture_deliver(data);
+}
+
+static gboolean capture_hide_tick(GtkWidget *capture_window,
+                                  GdkFrameClock *clock, gpointer pdata) {
+	capture_data *data = (capture_data *) pdata;
+
+	/*  The frame clock only starts a frame once the compositor has shown
+		the one before, so the cleared capture window is on the screen when
+		the second frame begins. The window is not destroyed from its own
+		tick. */
+	if (++data->frames < CAPTURE_HIDE_FRAMES)
+		return G_SOURCE_CONTINUE;
+	g_source_remove(data->timeout_id);
+	data->timeout_id = 0;
+	g_idle_add_full(G_PRIORITY_HIGH, capture_deliver, data, NULL);
+	return G_SOURCE_REMOVE;
+}
+
 static void capture_done(gpointer pdata) {
 	capture_data *data;
 	GdkSeat *seat;
+	cairo_region_t *region;
 
 	data = (capture_data *) pdata;
 	GdkDisplay *display = gdk_display_get_default();
 	seat = gdk_display_get_default_seat(display);
 	gdk_seat_ungrab(seat);
-	gtk_widget_destroy(data->window);
 	g_object_unref(data->cursor);
-	gdk_display_flush(display);
-
-	if (!data->aborted)
-		g_timeout_add(100, capture_crop_pixbuf, data);
-	else {
-		if (data->pixbuf != NULL)
-			g_object_unref(data->pixbuf);
-		free(data);
-		data->callback(NULL, data->cb_data);
+
+	if (data->aborted) {
+		gtk_widget_destroy(data->window);
+		gdk_display_flush(display);
+		data->callback(NULL, NULL, data->cb_data);
+		capture_data_free(data);
+		return;
+	}
+	
+	data->selected = TRUE;
+	data->selected_time = g_get_monotonic_time();
+	if (data->frame != NULL) {
+		capture_deliver(data);
+		return;
 	}
+
+	/*  With a compositor, the screen is composed from the contents of all
+		windows, so it is shown without the rubberband as soon as the frame
+		clock shows that the cleared capture window was drawn. Without one,
+		the windows below the rubberband have to repaint themselves when they
+		are exposed, which nothing tells when they are done with. The shape
+		change is made sure to have reached the X server, and then the fixed
+		delay is waited for them. */
+	if (gtk_widget_get_app_paintable(data->window)) {
+		gtk_widget_queue_draw(data->window);
+		gdk_display_flush(display);
+		gtk_widget_add_tick_callback(data->window, capture_hide_tick, data,
+			NULL);
+	} else {
+		region = cairo_region_create();
+		gdk_window_shape_combine_region(gtk_widget_get_window(data->window),
+			region, 0, 0);
+		cairo_region_destroy(region);
+		gdk_display_sync(display);
+	}
+	data->timeout_id = g_timeout_add(CAPTURE_HIDE_TIMEOUT,
+		capture_hide_timeout, data);
 }
 
 static gboolean capture_key_press(GtkWidget *capture_window, GdkEventKey *event,
                                   capture_data *data) {
+	if (data->selected)
+		return TRUE;
 	if (event->keyval == GDK_KEY_Escape) {
 		data->aborted = TRUE;
 		capture_done(data);
@@ -100,19 +370,13 @@ static gboolean capture_key_press(GtkWidget *capture_window, GdkEventKey *event,
 static gboolean capture_button_press(GtkWidget *capture_window,
                                      GdkEventButton *event,
                                      capture_data *data) {
-	GdkWindow *root;
-
-	if (data->button_pressed)
+	if (data->button_pressed || data->selected)
 		return TRUE;
 
 	data->button_pressed = TRUE;
 	data->rect.x = event->x_root;
 	data->rect.y = event->y_root;
 
-	root = gdk_get_default_root_window();
-	data->pixbuf = gdk_pixbuf_get_from_window(root, 0, 0,
-	               gdk_window_get_width(root), gdk_window_get_height(root));
-
 	return TRUE;
 }
 
@@ -121,7 +385,7 @@ static gboolean capture_motion_notify(GtkWidget *capture_window,
                                       capture_data *data) {
 	GdkRectangle draw_rect;
 
-	if (!data->button_pressed)
+	if (!data->button_pressed || data->selected)
 		return TRUE;
 
 	draw_rect.width = ABS(data->rect.x - event->x_root);
@@ -167,10 +431,34 @@ static gboolean capture_motion_notify(GtkWidget *capture_window,
 	return TRUE;
 }
 
+static gboolean frozen_motion_notify(GtkWidget *capture_window,
+                                     GdkEventMotion *event,
+                                     capture_data *data) {
+	GdkRectangle draw_rect;
+
+	if (!data->button_pressed || data->selected)
+		return TRUE;
+
+	draw_rect.width = ABS(data->rect.x - event->x_root);
+	draw_rect.height = ABS(data->rect.y - event->y_root);
+	draw_rect.x = MIN(data->rect.x, event->x_root);
+	draw_rect.y = MIN(data->rect.y, event->y_root);
+
+	/*  Only the old and the new rubberband are drawn again, once for all
+		motions until the next frame */
+	gtk_widget_queue_draw_area(capture_window, data->drawn.x, data->drawn.y,
+		data->drawn.width, data->drawn.height);
+	gtk_widget_queue_draw_area(capture_window, draw_rect.x, draw_rect.y,
+		draw_rect.width, draw_rect.height);
+	data->drawn = draw_rect;
+
+	return TRUE;
+}
+
 static gboolean capture_button_release(GtkWidget *capture_window,
                                        GdkEventButton *event,
                                        capture_data *data) {
-	if (!data->button_pressed)
+	if (!data->button_pressed || data->selected)
 		return TRUE;
 
 	data->rect.width = ABS(data->rect.x - event->x_root);
@@ -178,7 +466,7 @@ static gboolean capture_button_release(GtkWidget *capture_window,
 	data->rect.x = MIN(data->rect.x, event->x_root);
 	data->rect.y = MIN(data->rect.y, event->y_root);
 
-	if (data->rect.width <= 5 || data->rect.height <= 5 || data->pixbuf == NULL)
+	if (data->rect.width <= 5 || data->rect.height <= 5)
 		data->aborted = TRUE;
 
 	capture_done(data);
@@ -187,7 +475,7 @@ static gboolean capture_button_release(GtkWidget *capture_window,
 }
 
 static gboolean capture_window_draw(GtkWidget *capture_window, cairo_t *cr,
-                                    gpointer unused) {
+                                    capture_data *data) {
 	GtkStyleContext *style;
 
 	style = gtk_widget_get_style_context(capture_window);
@@ -196,6 +484,8 @@ static gboolean capture_window_draw(GtkWidget *capture_window, cairo_t *cr,
 		cairo_set_operator(cr, CAIRO_OPERATOR_SOURCE);
 		cairo_set_source_rgba(cr, 0, 0, 0, 0);
 		cairo_paint(cr);
+		if (data->selected)
+			return TRUE;
 
 		gtk_style_context_save(style);
 		gtk_style_context_add_class(style, GTK_STYLE_CLASS_RUBBERBAND);
@@ -213,6 +503,30 @@ static gboolean capture_window_draw(GtkWidget *capture_window, cairo_t *cr,
 	return TRUE;
 }
 
+static gboolean frozen_window_draw(GtkWidget *capture_window, cairo_t *cr,
+                                   capture_data *data) {
+	GtkStyleContext *style;
+
+	if (data->frame_surface == NULL)
+		return TRUE;
+	cairo_set_source_surface(cr, data->frame_surface, 0, 0);
+	cairo_set_operator(cr, CAIRO_OPERATOR_SOURCE);
+	cairo_paint(cr);
+	if (data->drawn.width <= 0 || data->drawn.height <= 0)
+		return TRUE;
+
+	style = gtk_widget_get_style_context(capture_window);
+	gtk_style_context_save(style);
+	gtk_style_context_add_class(style, GTK_STYLE_CLASS_RUBBERBAND);
+	gtk_render_background(style, cr, data->drawn.x, data->drawn.y,
+	                      data->drawn.width, data->drawn.height);
+	gtk_render_frame(style, cr, data->drawn.x, data->drawn.y,
+	                 data->drawn.width, data->drawn.height);
+	gtk_style_context_restore(style);
+
+	return TRUE;
+}
+
 static gboolean capture_grab(GtkWidget *capture_window, capture_data *data) {
 	GdkDisplay *display;
 	GdkSeat *seat;
@@ -239,40 +553,75 @@ static gboolean capture_grab(GtkWidget *capture_window, capture_data *data) {
 	return TRUE;
 }
 
-void capture(void (*callback)(GdkPixbuf *, gpointer), gpointer cb_data) {
+void capture(gboolean freeze,
+	void (*callback)(GdkPixbuf *, const GdkRectangle *, gpointer),
+	gpointer cb_data) {
 	capture_data *data;
 	GtkWidget *capture_window;
 	GdkScreen *screen;
 	GdkVisual *visual;
+	GdkWindow *root;
+	GdkRectangle root_rect = {0, 0, 0, 0};
 
 	data = malloc(sizeof(*data));
 	data->aborted = FALSE;
 	data->button_pressed = FALSE;
+	data->selected = FALSE;
+	data->selected_time = 0;
+	data->frames = 0;
+	data->timeout_id = 0;
 	data->rect.x = 0;
 	data->rect.y = 0;
 	data->rect.width  = 0;
 	data->rect.height = 0;
 	data->cursor = NULL;
-	data->pixbuf = NULL;
 	data->window = NULL;
+	data->frame = NULL;
+	data->frame_surface = NULL;
+	data->drawn = data->rect;
 	data->callback = callback;
 	data->cb_data = cb_data;
 
+	root = gdk_get_default_root_window();
+	root_rect.width = gdk_window_get_width(root);
+	root_rect.height = gdk_window_get_height(root);
+	data->scale = gdk_window_get_scale_factor(root);
+	if (freeze)
+		data->frame = capture_area(&root_rect);
+
 	capture_window = gtk_window_new(GTK_WINDOW_POPUP);
 	data->window = capture_window;
-	screen = gdk_screen_get_default();
-	if (screen) {
-		visual = gdk_screen_get_rgba_visual(screen);
-		if (gdk_screen_is_composited(screen) && visual) {
-			gtk_widget_set_visual(capture_window, visual);
-			gtk_widget_set_app_paintable(capture_window, TRUE);
+	if (data->frame != NULL) {
+		/*  The frozen screen covers the screen, the rubberband is drawn on
+			it */
+		gtk_widget_set_app_paintable(capture_window, TRUE);
+		g_signal_connect(capture_window, "draw",
+		                 G_CALLBACK(frozen_window_draw), data);
+		g_signal_connect(capture_window, "motion-notify-event",
+		                 G_CALLBACK(frozen_motion_notify), data);
+		gtk_window_move(GTK_WINDOW(capture_window), 0, 0);
+		gtk_window_resize(GTK_WINDOW(capture_window), root_rect.width,
+		                  root_rect.height);
+		gtk_widget_show(capture_window);
+		data->frame_surface = gdk_cairo_surface_create_from_pixbuf(
+			data->frame, data->scale, gtk_widget_get_window(capture_window));
+	} else {
+		screen = gdk_screen_get_default();
+		if (screen) {
+			visual = gdk_screen_get_rgba_visual(screen);
+			if (gdk_screen_is_composited(screen) && visual) {
+				gtk_widget_set_visual(capture_window, visual);
+				gtk_widget_set_app_paintable(capture_window, TRUE);
+			}
 		}
+		g_signal_connect(capture_window, "draw",
+		                 G_CALLBACK(capture_window_draw), data);
+		g_signal_connect(capture_window, "motion-notify-event",
+		                 G_CALLBACK(capture_motion_notify), data);
+		gtk_window_move(GTK_WINDOW(capture_window), -100, -100);
+		gtk_window_resize(GTK_WINDOW(capture_window), 10, 10);
+		gtk_widget_show(capture_window);
 	}
-	g_signal_connect(capture_window, "draw", G_CALLBACK(capture_window_draw),
-	                 NULL);
-	gtk_window_move(GTK_WINDOW(capture_window), -100, -100);
-	gtk_window_resize(GTK_WINDOW(capture_window), 10, 10);
-	gtk_widget_show(capture_window);
 
 	g_signal_connect(capture_window, "key-press-event",
 	                 G_CALLBACK(capture_key_press), data);
@@ -280,13 +629,102 @@ void capture(void (*callback)(GdkPixbuf *, gpointer), gpointer cb_data) {
 	                 G_CALLBACK(capture_button_press), data);
 	g_signal_connect(capture_window, "button-release-event",
 	                 G_CALLBACK(capture_button_release), data);
-	g_signal_connect(capture_window, "motion-notify-event",
-	                 G_CALLBACK(capture_motion_notify), data);
 
 	if (!capture_grab(capture_window, data)) {
 		gtk_widget_destroy(capture_window);
-		free(data);
-		callback(NULL, cb_data);
+		capture_data_free(data);
+		callback(NULL, NULL, cb_data);
 	}
 }
 
+/** Returns whether the capture b differs from a in any band of
+	CAPTURE_WATCH_BAND_HEIGHT rows by more than CAPTURE_WATCH_THRESHOLD on
+	average. Comparing bands rather than the whole capture notices a small
+	change like a new subtitle line in a large area.
+*/
+static int watch_changed(GdkPixbuf *a, GdkPixbuf *b) {
+	const guchar *pixels_a, *pixels_b;
+	int width, height, rowstride_a, rowstride_b, n_channels, y, band_end;
+	uint64_t difference;
+	
+	width = gdk_pixbuf_get_width(a);
+	height = gdk_pixbuf_get_height(a);
+	n_channels = gdk_pixbuf_get_n_channels(a);
+	/* The capture handed to capture_watch_start may come from elsewhere and
+		have other row strides */
+	rowstride_a = gdk_pixbuf_get_rowstride(a);
+	rowstride_b = gdk_pixbuf_get_rowstride(b);
+	if (width != gdk_pixbuf_get_width(b) || height != gdk_pixbuf_get_height(b)
+		|| n_channels != gdk_pixbuf_get_n_channels(b)
+		|| gdk_pixbuf_get_bits_per_sample(a) != 8
+		|| gdk_pixbuf_get_bits_per_sample(b) != 8)
+		return 1;
+	pixels_a = gdk_pixbuf_read_pixels(a);
+	pixels_b = gdk_pixbuf_read_pixels(b);
+	
+	for (y = 0; y < height; y = band_end) {
+		band_end = MIN(y + CAPTURE_WATCH_BAND_HEIGHT, height);
+		difference = 0;
+		for (; y < band_end; y++)
+			difference += pixel_convert_row_difference(
+				pixels_a + y * rowstride_a, pixels_b + y * rowstride_b,
+				width * n_channels);
+		if (difference > (uint64_t)CAPTURE_WATCH_THRESHOLD * width
+			* n_channels * CAPTURE_WATCH_BAND_HEIGHT)
+			return 1;
+	}
+	return 0;
+}
+
+static gboolean watch_read(gpointer pdata) {
+	capture_Watch *watch = (capture_Watch*)pdata;
+	GdkPixbuf *pixbuf;
+	
+	if ((pixbuf = capture_area(&watch->rect)) == NULL)
+		return G_SOURCE_CONTINUE;
+	if (watch->read != NULL && !watch_changed(watch->read, pixbuf))
+		watch->stable++;
+	else
+		watch->stable = 0;
+	if (watch->read != NULL)
+		g_object_unref(watch->read);
+	watch->read = pixbuf;
+	
+	/* The text is only recognized once it has stopped changing, and not
+		again if it changed back to what was recognized last */
+	if (watch->stable != CAPTURE_WATCH_STABLE_READS - 1
+		|| (watch->delivered != NULL
+		&& !watch_changed(watch->delivered, pixbuf)))
+		return G_SOURCE_CONTINUE;
+	if (watch->delivered != NULL)
+		g_object_unref(watch->delivered);
+	watch->delivered = g_object_ref(pixbuf);
+	watch->callback(pixbuf, &watch->rect, watch->cb_data);
+	return G_SOURCE_CONTINUE;
+}
+
+capture_Watch *capture_watch_start(const GdkRectangle *rect, int interval,
+	GdkPixbuf *recognized,
+	void (*callback)(GdkPixbuf *, const GdkRectangle *, gpointer),
+	gpointer cb_data) {
+	capture_Watch *watch;
+	
+	watch = malloc(sizeof(*watch));
+	watch->rect = *rect;
+	watch->read = NULL;
+	watch->delivered = recognized != NULL ? g_object_ref(recognized) : NULL;
+	watch->stable = 0;
+	watch->callback = callback;
+	watch->cb_data = cb_data;
+	watch->source_id = g_timeout_add(interval, watch_read, watch);
+	return watch;
+}
+
+void capture_watch_stop(capture_Watch *watch) {
+	g_source_remove(watch->source_id);
+	if (watch->read != NULL)
+		g_object_unref(watch->read);
+	if (watch->delivered != NULL)
+		g_object_unref(watch->delivered);
+	free(watch);
+}
@@ -21,4 +21,39 @@
 
 #include <gtk/gtk.h>
 
-void capture(void (*callback)(GdkPixbuf *, gpointer), gpointer cb_data);
+/** Lets the user select an area of the screen. callback gets a capture of
+	the selected area together with its rectangle on the screen, or NULL for
+	both if the capture was aborted. The capture is only valid during the
+	callback. If freeze is set, the screen is read once at the start and
+	shown still while selecting, and the capture is taken from that. This
+	reads all of the screen rather than only the selected area, which costs
+	more than moving the rubberband over the live screen does.
+*/
+void capture(gboolean freeze,
+	void (*callback)(GdkPixbuf *, const GdkRectangle *, gpointer),
+	gpointer cb_data);
+/** Copies the part rect of the screen into a new pixbuf right away, without
+	letting the user select it. Returns NULL if rect is off the screen.
+*/
+GdkPixbuf *capture_area(const GdkRectangle *rect);
+
+/* Reads of a watched area in a row that must be the same before it is handed
+	over and the mean difference of a band of rows, per color channel, above
+	which it counts as changed */
+#define CAPTURE_WATCH_STABLE_READS 2
+#define CAPTURE_WATCH_BAND_HEIGHT 16
+#define CAPTURE_WATCH_THRESHOLD 4
+
+typedef struct capture_Watch capture_Watch;
+
+/** Reads the area rect of the screen every interval milliseconds. Whenever it
+	has changed and then stayed the same for CAPTURE_WATCH_STABLE_READS reads,
+	callback gets a capture of it as described for capture. It also gets the
+	first stable capture, unless it is the same as recognized. recognized is
+	a capture of rect that was just recognized or NULL, it is referenced.
+*/
+capture_Watch *capture_watch_start(const GdkRectangle *rect, int interval,
+	GdkPixbuf *recognized,
+	void (*callback)(GdkPixbuf *, const GdkRectangle *, gpointer),
+	gpointer cb_data);
+void capture_watch_stop(capture_Watch *watch);
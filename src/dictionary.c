@@ -25,6 +25,7 @@
 
 #include "dictionary.h"
 #include "vector.h"
+#include "hashmap.h"
 #include "japanese_util.h"
 #include "string_util.h"
 
@@ -108,29 +109,91 @@ static int language_table_valid(sqlite3 *database, const Language *lang) {
 	return valid;
 }
 
-static void lang_vector_destroy(Vector *languages) {
+static void lang_vector_destroy(dictionary_Language_vector *languages) {
 	const Language *lang;
 	size_t pos = 0;
 	
-	while ((lang = vector_get_const(languages, pos++))) {
+	while ((lang = dictionary_language_vector_get(languages, pos++))) {
 		free(lang->display_name);
 		free(lang->table_name);
 		free(lang->column_name);
 	}
-	vector_destroy(languages);
+	dictionary_language_vector_destroy(languages);
+}
+
+/* All words of a dictionary table in binary order together with the
+	deinflection types of their entries. This way words and their prefixes can
+	be checked without querying the database. */
+typedef struct {
+	size_t word;
+	size_t len;
+	int types;
+} Headword;
+
+VECTOR_DEFINE(Headword_vector, headword_vector, Headword)
+
+typedef struct dictionary_Headword_index {
+	char *table_name;
+	char *words;
+	Headword_vector *headwords;
+} Headword_index;
+
+static void headword_index_destroy(Headword_index *index) {
+	free(index->table_name);
+	free(index->words);
+	headword_vector_destroy(index->headwords);
+	free(index);
+}
+
+static void indices_destroy(dictionary_Index_vector *indices) {
+	Headword_index **index;
+	size_t pos = 0;
+	
+	while ((index = dictionary_index_vector_get(indices, pos++)))
+		headword_index_destroy(*index);
+	dictionary_index_vector_destroy(indices);
+}
+
+static dictionary_Language_map *language_names_load(
+	dictionary_Language_vector *languages) {
+	dictionary_Language_map *names;
+	const Language *lang;
+	char *name;
+	size_t pos = 0;
+	
+	names = dictionary_language_map_create();
+	while ((lang = dictionary_language_vector_get(languages, pos++))) {
+		name = malloc(strlen(lang->table_name) + strlen(lang->column_name) + 1);
+		strcpy(name, lang->table_name);
+		strcat(name, lang->column_name);
+		if (!dictionary_language_map_add(names, name, pos - 1))
+			free(name);
+	}
+	return names;
+}
+
+static void language_names_destroy(dictionary_Language_map *names) {
+	dictionary_Language_map_entry *entry;
+	size_t pos = 0;
+	
+	while ((entry = dictionary_language_map_next(names, &pos)))
+		free((char*)entry->key);
+	dictionary_language_map_destroy(names);
 }
 
 void dictionary_destroy(Dictionary *dictionary) {
 	sqlite3_close(dictionary->database);
 	lang_vector_destroy(dictionary->languages);
+	language_names_destroy(dictionary->language_names);
+	indices_destroy(dictionary->indices);
 	free(dictionary);
 }
 
-static Vector *lang_vector_load(sqlite3 *database) {
+static dictionary_Language_vector *lang_vector_load(sqlite3 *database) {
 	const char * const QRY = "SELECT id, display_name, table_name, column_name, "
 		"deinflect FROM Languages;";
 	sqlite3_stmt *stmt;
-	Vector *languages;
+	dictionary_Language_vector *languages;
 	Language lang;
 	
 	if (sqlite3_prepare_v2(database, QRY, -1, &stmt, NULL) != SQLITE_OK) {
@@ -138,7 +201,7 @@ static Vector *lang_vector_load(sqlite3 *database) {
 			sqlite3_errmsg(database));
 		return NULL;
 	}
-	languages = vector_create(sizeof(lang));
+	languages = dictionary_language_vector_create();
 	while (sqlite3_step(stmt) == SQLITE_ROW) {
 		lang.id = sqlite3_column_int(stmt, 0);
 		lang.display_name = strdup((const char *)sqlite3_column_text(stmt, 1));
@@ -146,7 +209,7 @@ static Vector *lang_vector_load(sqlite3 *database) {
 		lang.column_name = strdup((const char *)sqlite3_column_text(stmt, 3));
 		lang.deinflect = sqlite3_column_int(stmt, 4);
 		
-		vector_append(languages, &lang);
+		dictionary_language_vector_append(languages, lang);
 		
 		if (!language_table_valid(database, &lang)) {
 			fprintf(stderr, "Tables for language '%s' are invalid.\n",
@@ -163,7 +226,7 @@ static Vector *lang_vector_load(sqlite3 *database) {
 Dictionary *dictionary_load(const char *dict_file_path) {
 	Dictionary *dict;
 	sqlite3 *database;
-	Vector *languages;
+	dictionary_Language_vector *languages;
 	
 	if (sqlite3_open(dict_file_path, &database)) {
 		fprintf(stderr, "Can't open dictionary database: %s\n",
@@ -181,7 +244,7 @@ Dictionary *dictionary_load(const char *dict_file_path) {
 		sqlite3_close(database);
 		return NULL;
 	}
-	if (vector_length(languages) == 0) {
+	if (dictionary_language_vector_length(languages) == 0) {
 		fprintf(stderr, "No languages in dictionary.\n");
 		lang_vector_destroy(languages);
 		sqlite3_close(database);
@@ -191,9 +254,158 @@ Dictionary *dictionary_load(const char *dict_file_path) {
 	dict = malloc(sizeof(*dict));
 	dict->database = database;
 	dict->languages = languages;
+	dict->language_names = language_names_load(languages);
+	dict->indices = dictionary_index_vector_create();
 	return dict;
 }
 
+const dictionary_Language *dictionary_find_language(Dictionary *dict,
+	const char *name) {
+	const size_t *pos;
+	
+	if ((pos = dictionary_language_map_get(dict->language_names, name)) == NULL)
+		return NULL;
+	return dictionary_language_vector_get(dict->languages, *pos);
+}
+
+static Headword_index *headword_index_load(sqlite3 *database,
+	const char *table_name) {
+	sqlite3_stmt *stmt;
+	const char * const QRY_FORMAT = "SELECT t.word, d.pos FROM %s_toc t "
+		"INNER JOIN %s d ON t.ent_id = d.id WHERE t.word IS NOT NULL "
+		"ORDER BY t.word;";
+	char *qry;
+	const char *word, *pos;
+	Headword_index *index;
+	Headword headword;
+	size_t len, words_capacity;
+	
+	qry = malloc(strlen(QRY_FORMAT) + 2 * strlen(table_name) + 1);
+	sprintf(qry, QRY_FORMAT, table_name, table_name);
+	if (sqlite3_prepare_v2(database, qry, -1, &stmt, NULL) != SQLITE_OK) {
+		free(qry);
+		fprintf(stderr, "headword_index_load prepare failed: %s\n",
+			sqlite3_errmsg(database));
+		return NULL;
+	}
+	free(qry);
+	
+	index = malloc(sizeof(*index));
+	index->table_name = strdup(table_name);
+	index->words = malloc(words_capacity = 65536);
+	index->headwords = headword_vector_create();
+	headword.word = headword.len = 0;
+	headword.types = -1;
+	while (sqlite3_step(stmt) == SQLITE_ROW) {
+		word = (const char*)sqlite3_column_text(stmt, 0);
+		len = sqlite3_column_bytes(stmt, 0);
+		pos = (const char*)sqlite3_column_text(stmt, 1);
+		
+		/* Rows of the same word follow each other, combine their types */
+		if (headword.types >= 0 && headword.len == len
+			&& memcmp(index->words + headword.word, word, len) == 0) {
+			headword.types |= pos == NULL ? 0 : jpn_pos_types(pos);
+			continue;
+		}
+		if (headword.types >= 0)
+			headword_vector_append(index->headwords, headword);
+		
+		headword.word += headword.len;
+		headword.len = len;
+		headword.types = pos == NULL ? 0 : jpn_pos_types(pos);
+		if (headword.word + len > words_capacity) {
+			while (headword.word + len > words_capacity)
+				words_capacity *= 2;
+			index->words = realloc(index->words, words_capacity);
+		}
+		memcpy(index->words + headword.word, word, len);
+	}
+	if (headword.types >= 0)
+		headword_vector_append(index->headwords, headword);
+	sqlite3_finalize(stmt);
+	
+	return index;
+}
+
+static int headword_compare(const Headword_index *index,
+	const Headword *headword, const char *word, size_t len) {
+	int cmp;
+	
+	cmp = memcmp(index->words + headword->word, word, MIN(headword->len, len));
+	if (cmp != 0)
+		return cmp;
+	return (headword->len > len) - (headword->len < len);
+}
+
+/** Returns the position of the first headword not less than word.
+*/
+static size_t headword_index_find(const Headword_index *index,
+	const char *word, size_t len) {
+	size_t low = 0, high = headword_vector_length(index->headwords), mid;
+	
+	while (low < high) {
+		mid = low + (high - low) / 2;
+		if (headword_compare(index, index->headwords->data + mid, word, len)
+			< 0)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+	return low;
+}
+
+static int headword_index_has_prefix(const char *prefix, size_t len,
+	void *pindex) {
+	Headword_index *index = (Headword_index*)pindex;
+	const Headword *headword;
+	
+	headword = headword_vector_get(index->headwords,
+		headword_index_find(index, prefix, len));
+	return headword != NULL && headword->len >= len
+		&& memcmp(index->words + headword->word, prefix, len) == 0;
+}
+
+/** Returns the deinflection types of word or -1 if it is not in index.
+*/
+static int headword_index_types(Headword_index *index, const char *word,
+	size_t len) {
+	const Headword *headword;
+	
+	headword = headword_vector_get(index->headwords,
+		headword_index_find(index, word, len));
+	if (headword == NULL || headword_compare(index, headword, word, len) != 0)
+		return -1;
+	return headword->types;
+}
+
+/** Returns the headword index of the table of lang and loads it on first use.
+*/
+static Headword_index *dictionary_get_index(Dictionary *dict,
+	const Language *lang) {
+	Headword_index **index_p;
+	Headword_index *index;
+	size_t pos = 0;
+	
+	while ((index_p = dictionary_index_vector_get(dict->indices, pos++))) {
+		if (strcmp((*index_p)->table_name, lang->table_name) == 0)
+			return *index_p;
+	}
+	
+	if ((index = headword_index_load(dict->database, lang->table_name))
+		== NULL)
+		return NULL;
+	dictionary_index_vector_append(dict->indices, index);
+	return index;
+}
+
+void dictionary_load_indices(Dictionary *dict) {
+	const Language *lang;
+	size_t pos = 0;
+	
+	while ((lang = dictionary_language_vector_get(dict->languages, pos++)))
+		dictionary_get_index(dict, lang);
+}
+
 typedef struct {
 	unsigned int id;
 	char *japanese;
@@ -201,14 +413,19 @@ typedef struct {
 	char *translation;
 } Query_result;
 
-static Vector *query_database(Dictionary *dict, const char* word,
-	const Language *lang) {
+VECTOR_DEFINE(Query_result_vector, query_result_vector, Query_result)
+
+HASHSET_DEFINE(Id_set, id_set, unsigned int, hashmap_hash_int,
+	HASHMAP_EQUALS_INT)
+
+static Query_result_vector *query_database(Dictionary *dict, const char* word,
+	size_t word_len, const Language *lang) {
 	sqlite3_stmt *stmt;
 	const char * const QRY_FORMAT = "SELECT d.id, d.japanese, d.pos, d.%s FROM "
 		"%s d INNER JOIN %s_toc t ON t.ent_id = d.id WHERE t.word = ?;";
 	char *qry;
 	const char *res;
-	Vector *results;
+	Query_result_vector *results;
 	Query_result result;
 	
 	qry = malloc(strlen(QRY_FORMAT) + strlen(lang->table_name)
@@ -222,13 +439,14 @@ static Vector *query_database(Dictionary *dict, const char* word,
 		return NULL;
 	}
 	free(qry);
-	if (sqlite3_bind_text(stmt, 1, word, -1, SQLITE_STATIC) != SQLITE_OK) {;
+	if (sqlite3_bind_text(stmt, 1, word, word_len, SQLITE_STATIC)
+		!= SQLITE_OK) {
 		fprintf(stderr, "query_database bind failed: %s\n",
 			sqlite3_errmsg(dict->database));
 		return NULL;
 	}
 	
-	results = vector_create(sizeof(result));
+	results = query_result_vector_create();
 	while (sqlite3_step(stmt) == SQLITE_ROW) {
 		result.id = sqlite3_column_int(stmt, 0);
 		res = (char*)sqlite3_column_text(stmt, 1);
@@ -237,53 +455,74 @@ static Vector *query_database(Dictionary *dict, const char* word,
 		result.pos = res == NULL ? calloc(1, 1) : strdup(res);
 		res = (char*)sqlite3_column_text(stmt, 3);
 		result.translation = res == NULL ? calloc(1, 1) : strdup(res);
-		vector_append(results, &result);
+		query_result_vector_append(results, result);
 	}
 	sqlite3_finalize(stmt);
 	
 	return results;
 }
 
-static void results_destroy(Vector *results) {
+static void results_destroy(Query_result_vector *results) {
 	const Query_result *result;
 	size_t pos = 0;
 	
-	while ((result = vector_get_const(results, pos++))) {
+	while ((result = query_result_vector_get(results, pos++))) {
 		free(result->japanese);
 		free(result->pos);
 		free(result->translation);
 	}
-	vector_destroy(results);
+	query_result_vector_destroy(results);
 }
 
 static void append_matching_results(char **buf, size_t *buf_size,
-	Vector *results, const jpn_Variant *variant, Vector *previous_result_ids) {
+	Query_result_vector *results, const jpn_Variants *variants,
+	const jpn_Variant *variant, jpn_Rule_vector *rules,
+	Id_set *previous_result_ids) {
 	const Query_result *result;
+	char *reason = NULL;
 	size_t pos = 0;
 	
-	while ((result = vector_get_const(results, pos++))) {
+	while ((result = query_result_vector_get(results, pos++))) {
 		if (!jpn_is_correctly_deinflected(variant->type, result->pos)
-			|| vector_find(previous_result_ids, &result->id, memcmp)
-			!= vector_length(previous_result_ids))
+			|| !id_set_add(previous_result_ids, result->id))
 			continue;
-			
-		vector_append(previous_result_ids, &result->id);
+		
+		/* Only variants that yield results need their reason */
+		if (reason == NULL)
+			reason = jpn_variant_reason(variants, variant, rules);
 		
 		*buf_size = strcat_realloc(buf, result->japanese, *buf_size, "\n");
-		if (variant->reason != NULL)
-			*buf_size = strcat_realloc(buf, variant->reason, *buf_size, "\t");
+		if (reason != NULL)
+			*buf_size = strcat_realloc(buf, reason, *buf_size, "\t");
 		*buf_size = strcat_realloc(buf, result->pos, *buf_size, "\n");
 		*buf_size = strcat_realloc(buf, result->translation, *buf_size, "\n");
 	}
+	free(reason);
 }
 
 char* dictionary_lookup(Dictionary *dict, const char* text,
-	const Language *lang, Vector *rules) {
+	const Language *lang, jpn_Rule_vector *rules, const jpn_Budget *budget,
+	int *truncated) {
 	char *text1, *text2, *buffer;
-	Vector *words_lookup, *results;
+	jpn_Variants *words_lookup;
+	Query_result_vector *results;
 	const jpn_Variant *variant;
-	size_t pos_v, buffer_size;
-	Vector *result_ids;
+	Headword_index *index;
+	size_t pos_v, buffer_size, max_work = 0;
+	Id_set *result_ids;
+	int types;
+	gint64 deadline = 0;
+	
+	if ((index = dictionary_get_index(dict, lang)) == NULL)
+		return NULL;
+	
+	/* The clock starts after the index is loaded, which takes long for the
+		first lookup of a language and would use up the budget */
+	if (budget != NULL) {
+		max_work = budget->max_work;
+		if (budget->max_time != 0)
+			deadline = g_get_monotonic_time() + budget->max_time;
+	}
 	
 	text1 = jpn_half2fullwidth(text);
 	text2 = jpn_katakana2hiragana(text1);
@@ -291,27 +530,42 @@ char* dictionary_lookup(Dictionary *dict, const char* text,
 	
 	/* If we should not deinflect, act as there were no rules to apply */
 	if (!lang->deinflect)
-		rules = vector_create(1);
-	words_lookup = jpn_get_all_variants(text2, rules);
+		rules = jpn_rule_vector_create();
+	words_lookup = jpn_get_all_variants(text2, rules,
+		headword_index_has_prefix, index, max_work, deadline);
+	*truncated = words_lookup->truncated;
 	g_free(text2);
 	
-	result_ids = vector_create(sizeof(((Query_result*)NULL)->id));
+	result_ids = id_set_create();
 	buffer = malloc(buffer_size = 2048);
 	*buffer = 0;
 	pos_v = 0;
-	while ((variant = vector_get_const(words_lookup, pos_v++))) {
-		if ((results = query_database(dict, variant->word, lang)) == NULL)
+	while ((variant = jpn_variant_vector_get(words_lookup->variants,
+		pos_v++))) {
+		/* Only query words that exist with a fitting part of speech */
+		types = headword_index_types(index,
+			jpn_variant_word(words_lookup, variant), variant->word_len);
+		if (types < 0 || (variant->type != 0xFF && !(variant->type & types)))
+			continue;
+		if (deadline != 0 && g_get_monotonic_time() > deadline) {
+			*truncated = 1;
+			break;
+		}
+		
+		if ((results = query_database(dict,
+			jpn_variant_word(words_lookup, variant), variant->word_len, lang))
+			== NULL)
 			return NULL;
 		
-		append_matching_results(&buffer, &buffer_size, results, variant,
-			result_ids);
+		append_matching_results(&buffer, &buffer_size, results, words_lookup,
+			variant, rules, result_ids);
 		results_destroy(results);
 	}
 	
-	vector_destroy(result_ids);
+	id_set_destroy(result_ids);
 	jpn_variants_destroy(words_lookup);
 	if (!lang->deinflect)
-		vector_destroy(rules);
+		jpn_rule_vector_destroy(rules);
 	
 	return buffer;
 }
@@ -21,6 +21,8 @@
 
 #include <sqlite3.h>
 #include "vector.h"
+#include "hashmap.h"
+#include "japanese_util.h"
 
 typedef struct {
 	int id;
@@ -30,12 +32,39 @@ typedef struct {
 	int deinflect;
 } dictionary_Language;
 
+VECTOR_DEFINE(dictionary_Language_vector, dictionary_language_vector,
+	dictionary_Language)
+HASHMAP_DEFINE(dictionary_Language_map, dictionary_language_map, const char*,
+	size_t, hashmap_hash_string, hashmap_equals_string)
+
+struct dictionary_Headword_index;
+VECTOR_DEFINE(dictionary_Index_vector, dictionary_index_vector,
+	struct dictionary_Headword_index*)
+
 typedef struct {
 	sqlite3 *database;
-	Vector *languages;
+	dictionary_Language_vector *languages;
+	/* Positions in languages by table name followed by column name */
+	dictionary_Language_map *language_names;
+	/* Headword indices of the tables looked up so far */
+	dictionary_Index_vector *indices;
 } Dictionary;
 
 Dictionary *dictionary_load(const char *dict_file_path);
 void dictionary_destroy(Dictionary *dictionary);
+/** Returns the language whose table name followed by its column name is name
+	or NULL if there is none.
+*/
+const dictionary_Language *dictionary_find_language(Dictionary *dict,
+	const char *name);
+/** Loads the headword indices of all languages, which lookups otherwise load
+	on first use.
+*/
+void dictionary_load_indices(Dictionary *dict);
+/** Looks up the words at the start of text. Longer matches and matches with
+	fewer deinflections are looked up first. If budget is not NULL and runs
+	out, the results found so far are returned and truncated is set.
+*/
 char* dictionary_lookup(Dictionary *dict, const char* text,
-	const dictionary_Language *lang, Vector *rules);
+	const dictionary_Language *lang, jpn_Rule_vector *rules,
+	const jpn_Budget *budget, int *truncated);
@@ -0,0 +1,304 @@
+/*
+ * Copyright 2017 sprin0
+ * 
+ * This file is part of JpnCap.
+ * 
+ * JpnCap is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * JpnCap is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with JpnCap.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Hash maps and sets with open addressing and linear probing. All entries are
+	stored in one array, whose capacity is a power of two and which is kept at
+	most three quarters full. A stored hash of 0 marks an empty slot. Removed
+	entries are filled by moving the following entries back, so there are no
+	tombstones. */
+
+/** Hashes the null terminated string key (FNV-1a).
+*/
+static inline size_t hashmap_hash_string(const char *key) {
+	uint64_t hash = 14695981039346656037ULL;
+
+	while (*key) {
+		hash ^= (unsigned char)*key++;
+		hash *= 1099511628211ULL;
+	}
+	return (size_t)hash;
+}
+
+/** Hashes the len bytes at key (FNV-1a).
+*/
+static inline size_t hashmap_hash_bytes(const char *key, size_t len) {
+	uint64_t hash = 14695981039346656037ULL;
+
+	while (len--) {
+		hash ^= (unsigned char)*key++;
+		hash *= 1099511628211ULL;
+	}
+	return (size_t)hash;
+}
+
+/** Hashes the integer key. Consecutive integers are spread over all bits.
+*/
+static inline size_t hashmap_hash_int(uint64_t key) {
+	key ^= key >> 30;
+	key *= 0xbf58476d1ce4e5b9ULL;
+	key ^= key >> 27;
+	key *= 0x94d049bb133111ebULL;
+	key ^= key >> 31;
+	return (size_t)key;
+}
+
+/** Compares the string element with key, returns 0 on equality.
+*/
+static inline int hashmap_equals_string(const char *const *element,
+	const char *key) {
+	return strcmp(*element, key);
+}
+
+/** Compares the integer element with key, returns 0 on equality.
+*/
+#define HASHMAP_EQUALS_INT(element, key) (*(element) != (key))
+
+/* Code shared by HASHMAP_DEFINE and HASHSET_DEFINE. Entry must have the
+	members hash and key. */
+#define HASHTABLE_DEFINE_(Name, prefix, Entry, Key, hash_func, equals) \
+typedef struct { \
+	size_t length; \
+	size_t capacity; \
+	Entry *entries; \
+} Name; \
+\
+static inline Name *prefix##_create(void) { \
+	Name *table; \
+	\
+	table = malloc(sizeof(*table)); \
+	table->length = 0; \
+	table->capacity = 16; \
+	table->entries = calloc(table->capacity, sizeof(Entry)); \
+	return table; \
+} \
+\
+static inline void prefix##_destroy(Name *table) { \
+	free(table->entries); \
+	free(table); \
+} \
+\
+static inline size_t prefix##_length(const Name *table) { \
+	return table->length; \
+} \
+\
+static inline size_t prefix##_hash_(Key key) { \
+	size_t hash = hash_func(key); \
+	\
+	return hash == 0 ? 1 : hash; \
+} \
+\
+/* Returns the slot of key or the empty slot where it belongs. */ \
+static inline size_t prefix##_slot_(const Name *table, Key key, \
+	size_t hash) { \
+	size_t mask = table->capacity - 1, i = hash & mask; \
+	\
+	while (table->entries[i].hash != 0 && (table->entries[i].hash != hash \
+		|| equals(&table->entries[i].key, key) != 0)) \
+		i = (i + 1) & mask; \
+	return i; \
+} \
+\
+static inline void prefix##_grow_(Name *table) { \
+	Entry *old_entries = table->entries; \
+	size_t old_capacity = table->capacity, i, j, mask; \
+	\
+	table->capacity *= 2; \
+	table->entries = calloc(table->capacity, sizeof(Entry)); \
+	mask = table->capacity - 1; \
+	for (i = 0; i < old_capacity; i++) { \
+		if (old_entries[i].hash == 0) \
+			continue; \
+		for (j = old_entries[i].hash & mask; table->entries[j].hash != 0; \
+			j = (j + 1) & mask); \
+		table->entries[j] = old_entries[i]; \
+	} \
+	free(old_entries); \
+} \
+\
+/* Returns the entry of key. If there is none, a new one is made and added is \
+	set. Its value is left for the caller to set. */ \
+static inline Entry *prefix##_entry_(Name *table, Key key, int *added) { \
+	size_t hash = prefix##_hash_(key), i; \
+	\
+	i = prefix##_slot_(table, key, hash); \
+	*added = table->entries[i].hash == 0; \
+	if (!*added) \
+		return table->entries + i; \
+	if (4 * (table->length + 1) > 3 * table->capacity) { \
+		prefix##_grow_(table); \
+		i = prefix##_slot_(table, key, hash); \
+	} \
+	table->entries[i].hash = hash; \
+	table->entries[i].key = key; \
+	table->length++; \
+	return table->entries + i; \
+} \
+\
+static inline int prefix##_remove(Name *table, Key key) { \
+	size_t mask = table->capacity - 1, i, j, home; \
+	\
+	i = prefix##_slot_(table, key, prefix##_hash_(key)); \
+	if (table->entries[i].hash == 0) \
+		return 0; \
+	\
+	/* Move back following entries that would not be found anymore */ \
+	for (j = (i + 1) & mask; table->entries[j].hash != 0; \
+		j = (j + 1) & mask) { \
+		home = table->entries[j].hash & mask; \
+		if (((j - home) & mask) >= ((j - i) & mask)) { \
+			table->entries[i] = table->entries[j]; \
+			i = j; \
+		} \
+	} \
+	table->entries[i].hash = 0; \
+	table->length--; \
+	return 1; \
+} \
+\
+static inline void prefix##_clear(Name *table) { \
+	memset(table->entries, 0, table->capacity * sizeof(Entry)); \
+	table->length = 0; \
+} \
+\
+static inline Entry *prefix##_next(const Name *table, size_t *pos) { \
+	while (*pos < table->capacity) \
+		if (table->entries[(*pos)++].hash != 0) \
+			return table->entries + *pos - 1; \
+	return NULL; \
+}
+
+/** Defines the hash map type Name mapping Key to Value together with its
+	functions, which are all prefixed with prefix:
+
+	Name *prefix_create(void)
+		Creates a new, empty map.
+	void prefix_destroy(Name *map)
+		Frees all memory of map, but not the memory its keys and values point
+		to.
+	size_t prefix_length(const Name *map)
+		Returns the number of entries in map.
+	Value *prefix_get(const Name *map, Key key)
+		Returns a pointer to the value of key or NULL if key is not in map.
+		The pointer becomes invalid upon adding entries to or removing entries
+		from map.
+	int prefix_set(Name *map, Key key, Value value)
+		Sets the value of key to value. Returns 1 if key was added and 0 if it
+		was already in map, in which case the old key is kept.
+	int prefix_add(Name *map, Key key, Value value)
+		Adds key with value if key is not in map yet. Returns 1 if key was
+		added and 0 if it was already in map, which is left unchanged then.
+	int prefix_remove(Name *map, Key key)
+		Removes key from map. Returns 1 if key was in map.
+	void prefix_clear(Name *map)
+		Removes all entries of map.
+	Name_entry *prefix_next(const Name *map, size_t *pos)
+		Returns the next entry of map starting at *pos, which should be 0 at
+		first, or NULL if there are no more entries. The entries have the
+		members key and value.
+
+	hash_func is a function size_t hash_func(Key key). equals is a function
+	int equals(const Key *element, Key key) that returns 0 if element matches
+	key. Both should be static inline, see hashmap_hash_string and
+	hashmap_equals_string for example.
+*/
+#define HASHMAP_DEFINE(Name, prefix, Key, Value, hash_func, equals) \
+typedef struct { \
+	size_t hash; \
+	Key key; \
+	Value value; \
+} Name##_entry; \
+\
+HASHTABLE_DEFINE_(Name, prefix, Name##_entry, Key, hash_func, equals) \
+\
+static inline Value *prefix##_get(const Name *map, Key key) { \
+	size_t i = prefix##_slot_(map, key, prefix##_hash_(key)); \
+	\
+	if (map->entries[i].hash == 0) \
+		return NULL; \
+	return &map->entries[i].value; \
+} \
+\
+static inline int prefix##_set(Name *map, Key key, Value value) { \
+	int added; \
+	\
+	prefix##_entry_(map, key, &added)->value = value; \
+	return added; \
+} \
+\
+static inline int prefix##_add(Name *map, Key key, Value value) { \
+	Name##_entry *entry; \
+	int added; \
+	\
+	entry = prefix##_entry_(map, key, &added); \
+	if (added) \
+		entry->value = value; \
+	return added; \
+}
+
+/** Defines the hash set type Name holding elements of Key together with its
+	functions, which are all prefixed with prefix:
+
+	Name *prefix_create(void)
+		Creates a new, empty set.
+	void prefix_destroy(Name *set)
+		Frees all memory of set, but not the memory its keys point to.
+	size_t prefix_length(const Name *set)
+		Returns the number of keys in set.
+	int prefix_contains(const Name *set, Key key)
+		Returns whether key is in set.
+	int prefix_add(Name *set, Key key)
+		Adds key to set. Returns 1 if key was added and 0 if it was already in
+		set.
+	int prefix_remove(Name *set, Key key)
+		Removes key from set. Returns 1 if key was in set.
+	void prefix_clear(Name *set)
+		Removes all keys of set.
+	Name_entry *prefix_next(const Name *set, size_t *pos)
+		Returns the next entry of set starting at *pos, which should be 0 at
+		first, or NULL if there are no more entries. The entries have the
+		member key.
+
+	hash_func and equals are as described for HASHMAP_DEFINE.
+*/
+#define HASHSET_DEFINE(Name, prefix, Key, hash_func, equals) \
+typedef struct { \
+	size_t hash; \
+	Key key; \
+} Name##_entry; \
+\
+HASHTABLE_DEFINE_(Name, prefix, Name##_entry, Key, hash_func, equals) \
+\
+static inline int prefix##_contains(const Name *set, Key key) { \
+	return set->entries[prefix##_slot_(set, key, prefix##_hash_(key))].hash \
+		!= 0; \
+} \
+\
+static inline int prefix##_add(Name *set, Key key) { \
+	int added; \
+	\
+	prefix##_entry_(set, key, &added); \
+	return added; \
+}
@@ -18,6 +18,7 @@
  */
 
 #include "vector.h"
+#include "hashmap.h"
 #include "japanese_util.h"
 #include "string_util.h"
 
@@ -32,7 +33,10 @@
 typedef jpn_Rule Rule;
 typedef jpn_Variant Variant;
 
-static int rule_parse(const char *line, Vector *reasons, Rule *rule) {
+VECTOR_DEFINE(Reason_vector, reason_vector, char*)
+
+static int rule_parse(const char *line, Reason_vector *reasons,
+	Rule *rule) {
 	int reason_number;
 	char *line2, *line3, *token;
 	const char* reason;
@@ -62,13 +66,13 @@ static int rule_parse(const char *line, Vector *reasons, Rule *rule) {
 	token = line2;
 	line2 = string_split_char(line2, '\t');
 	reason_number = atoi(token);
-	if (strlen(token) > 8 || vector_length(reasons) <= reason_number) {
+	if (strlen(token) > 8 || reason_vector_length(reasons) <= reason_number) {
 		free(rule->to);
 		free(rule->from);
 		free(line2);
 		return 0;
 	}
-	reason = *(const char**)vector_get_const(reasons, reason_number);
+	reason = reasons->data[reason_number];
 	rule->reason = strdup(reason);
 	
 	free(line3);
@@ -76,9 +80,10 @@ static int rule_parse(const char *line, Vector *reasons, Rule *rule) {
 	return 1;
 }
 
-Vector *jpn_deinflect_load(const char *file_path) {
+jpn_Rule_vector *jpn_deinflect_load(const char *file_path) {
 	FILE *file;
-	Vector *rules, *reasons;
+	jpn_Rule_vector *rules;
+	Reason_vector *reasons;
 	Rule rule;
 	char *reason;
 	char *const*r_p;
@@ -91,8 +96,8 @@ Vector *jpn_deinflect_load(const char *file_path) {
 		return NULL;
 	}
 	
-	rules = vector_create(sizeof(rule));
-	reasons = vector_create(sizeof(reason));
+	rules = jpn_rule_vector_create();
+	reasons = reason_vector_create();
 	line = NULL;
 	line_number = 0;
 	while (getline(&line, &len, file) != -1) {
@@ -120,49 +125,74 @@ Vector *jpn_deinflect_load(const char *file_path) {
 					file_path);
 				continue;
 			}
-			vector_append(rules, &rule);
+			jpn_rule_vector_append(rules, rule);
 		} else {
 			reason = strdup(line);
-			vector_append(reasons, &reason);
+			reason_vector_append(reasons, reason);
 		}
 	}
 	
 	free(line);
 	pos = 0;
-	while ((r_p = vector_get_const(reasons, pos++)))
+	while ((r_p = reason_vector_get(reasons, pos++)))
 		free(*r_p);
-	vector_destroy(reasons);
+	reason_vector_destroy(reasons);
 	fclose(file);
 	
 	return rules;
 }
 
-void jpn_rules_destroy(Vector *rules) {
+void jpn_rules_destroy(jpn_Rule_vector *rules) {
 	const Rule *rule;
 	size_t pos = 0;
 	
-	while ((rule = vector_get_const(rules, pos++))) {
+	while ((rule = jpn_rule_vector_get(rules, pos++))) {
 		free(rule->from);
 		free(rule->to);
 		free(rule->reason);
 	}
-	vector_destroy(rules);
+	jpn_rule_vector_destroy(rules);
 }
 
-static int rule_applies(const char *word, int type, const Rule *rule) {
-	const char *suffix;
-	size_t len = strlen(word);
-	
-	suffix = word + len - rule->from_len;
+static int rule_applies(const char *word, size_t len, int type,
+	const Rule *rule) {
 	return (len >= rule->from_len)
 		&& (type & rule->type)
-		&& (strcmp(suffix, rule->from) == 0);
+		&& (memcmp(word + len - rule->from_len, rule->from, rule->from_len)
+			== 0);
+}
+
+/** Makes sure there is space for len more bytes in the words buffer.
+*/
+static void variants_reserve_words(jpn_Variants *variants, size_t len) {
+	if (variants->words_len + len <= variants->words_capacity)
+		return;
+	
+	while (variants->words_len + len > variants->words_capacity)
+		variants->words_capacity *= 2;
+	variants->words = realloc(variants->words, variants->words_capacity);
 }
 
-static int find_variant(const void* a, const void* b, size_t size) {
-	return strcmp(((const Variant*)a)->word, ((const Variant*)b)->word);
+/* A word in the words buffer of a jpn_Variants. It refers to the buffer
+	through its pointer in jpn_Variants, as the buffer may be moved. */
+typedef struct {
+	char *const *words;
+	size_t word;
+	size_t len;
+} Word;
+
+static inline size_t word_hash(Word word) {
+	return hashmap_hash_bytes(*word.words + word.word, word.len);
 }
 
+static inline int word_equals(const Word *a, Word b) {
+	return a->len != b.len
+		|| memcmp(*a->words + a->word, *b.words + b.word, b.len) != 0;
+}
+
+/* Maps the words of variants to the position of the first variant with it */
+HASHMAP_DEFINE(Word_map, word_map, Word, size_t, word_hash, word_equals)
+
 static char *concatenate_reasons(const char* old_reason, const char* reason) {
 	char *new_reason;
 	
@@ -181,76 +211,203 @@ static char *concatenate_reasons(const char* old_reason, const char* reason) {
 	return new_reason;
 }
 
-Vector *jpn_get_all_variants(const char *text, Vector *rules) {
+/** Calculates for every character boundary k of text the lowest position down
+	to which rules could replace text[0..k], ignoring the word types. Rules
+	can only replace text if it is the start of their from string.
+*/
+static void lowest_replaceable(const char *text, const size_t *boundaries,
+	size_t n, jpn_Rule_vector *rules, size_t *lowest) {
+	const Rule *rule_p;
+	size_t k, i, pos_r, m;
+	
+	for (k = 0; k <= n; k++) {
+		lowest[k] = boundaries[k];
+		pos_r = 0;
+		while ((rule_p = jpn_rule_vector_get(rules, pos_r++))) {
+			for (i = k; i-- > 0;) {
+				m = boundaries[k] - boundaries[i];
+				if (m > rule_p->from_len)
+					break;
+				if (lowest[i] < lowest[k]
+					&& memcmp(text + boundaries[i], rule_p->from, m) == 0)
+					lowest[k] = lowest[i];
+			}
+		}
+	}
+}
+
+/** Returns the longest common prefix of a and text rounded down to the last
+	character boundary as an index into boundaries.
+*/
+static size_t common_prefix(const char *a, size_t len, const char *text,
+	const size_t *boundaries, size_t n) {
+	size_t k;
+	
+	for (k = 0; k < n && boundaries[k + 1] <= len
+		&& memcmp(a + boundaries[k], text + boundaries[k],
+			boundaries[k + 1] - boundaries[k]) == 0; k++);
+	return k;
+}
+
+/** Finds all variants of the prefixes of text. The search stops when more than
+	max_work rule tests have been made or the monotonic time passed deadline.
+	Zero means no limit for both.
+*/
+jpn_Variants *jpn_get_all_variants(const char *text, jpn_Rule_vector *rules,
+	jpn_Prefix_func has_prefix, void *prefix_data, size_t max_work,
+	int64_t deadline) {
 	glong pos;
 	gchar *text2;
-	Variant variant, *old_variant;
-	Vector *variants = vector_create(sizeof(variant));
-	size_t old_variant_pos, pos_v, pos_r;
-	const Variant *variant_p;
+	size_t boundaries[14], lowest[14], n, reach;
+	jpn_Variants *variants;
+	Variant variant, *variant_p;
+	size_t *old_variant_pos, pos_v, pos_r, text2_len, work = 0;
+	Word_map *variant_words;
+	Word word;
 	const Rule *rule_p;
-	int i;
+	char *new_word;
 	
 	/* Copy the text and cut it if it's too long */
 	text2 = g_utf8_substring((const gchar*)text, 0,
 		g_utf8_strlen(text, 60) > 13 ? 13 : g_utf8_strlen(text, 60));
+	text2_len = strlen(text2);
 	
-	for (pos = g_utf8_strlen(text2, 100); pos; pos--) {
-		*g_utf8_offset_to_pointer(text2, pos) = 0;
-		
-		variant.word = strdup((char*)text2);
+	/* Find out how much of the text's start is also the start of a word in
+		the dictionary. Any variant whose replaceable part can't reach back into
+		that start can't lead to a word in the dictionary. */
+	n = g_utf8_strlen(text2, -1);
+	for (pos = 0; pos <= n; pos++)
+		boundaries[pos] = g_utf8_offset_to_pointer(text2, pos) - text2;
+	if (has_prefix != NULL) {
+		lowest_replaceable(text2, boundaries, n, rules, lowest);
+		for (reach = 0; reach < n && has_prefix(text2, boundaries[reach + 1],
+			prefix_data); reach++);
+	} else
+		reach = n;
+	
+	/* The text itself is at the start of the words buffer, so all prefixes of
+		it can refer to it without copying. */
+	variants = malloc(sizeof(*variants));
+	variants->variants = jpn_variant_vector_create();
+	variants->words_capacity = 256;
+	while (variants->words_capacity < text2_len)
+		variants->words_capacity *= 2;
+	variants->words = malloc(variants->words_capacity);
+	memcpy(variants->words, text2, text2_len);
+	variants->words_len = text2_len;
+	variants->truncated = 0;
+	variant_words = word_map_create();
+	word.words = &variants->words;
+	
+	for (pos = g_utf8_strlen(text2, 100); pos && !variants->truncated; pos--) {
+		variant.word = 0;
+		variant.word_len = g_utf8_offset_to_pointer(text2, pos) - text2;
+		variant.parent = -1;
+		variant.rule = -1;
 		variant.type = 0xFF;
-		variant.reason = NULL;
-		vector_append(variants, &variant);
+		variant.expanded = 0;
+		word.word = variant.word;
+		word.len = variant.word_len;
+		word_map_add(variant_words, word,
+			jpn_variant_vector_length(variants->variants));
+		jpn_variant_vector_append(variants->variants, variant);
 		
-		/* Try every rule to every variant found until now */
+		/* Try every rule to every variant found until now. Trying them again
+			only finds something new if the variant got new types since. */
 		pos_v = 0;
-		while ((variant_p = vector_get_const(variants, pos_v++))) {
-			i = 0;
+		while ((variant_p = jpn_variant_vector_get(variants->variants,
+			pos_v++))) {
+			if (variant_p->expanded == variant_p->type)
+				continue;
+			variant_p->expanded = variant_p->type;
+			
+			if (has_prefix != NULL && lowest[common_prefix(
+				variants->words + variant_p->word, variant_p->word_len,
+				text2, boundaries, n)] > boundaries[reach])
+				continue;
+			
+			work += jpn_rule_vector_length(rules);
+			if ((max_work != 0 && work > max_work)
+				|| (deadline != 0 && g_get_monotonic_time() > deadline)) {
+				variants->truncated = 1;
+				break;
+			}
+			
 			pos_r = 0;
-			while ((rule_p = vector_get_const(rules, pos_r++))) {
-				i++;
-				if (!rule_applies(variant_p->word, variant_p->type, rule_p))
+			while ((rule_p = jpn_rule_vector_get(rules, pos_r++))) {
+				if (!rule_applies(variants->words + variant_p->word,
+					variant_p->word_len, variant_p->type, rule_p))
 					continue;
 				
-				variant.word = string_suffix_replace(variant_p->word,
-					rule_p->from_len, rule_p->to);
+				/* Write the new word behind the used part of the words buffer
+					and only keep it there if it is a new variant. */
+				variant.word_len = variant_p->word_len - rule_p->from_len
+					+ rule_p->to_len;
+				variants_reserve_words(variants, variant.word_len);
+				new_word = variants->words + variants->words_len;
+				memcpy(new_word, variants->words + variant_p->word,
+					variant_p->word_len - rule_p->from_len);
+				memcpy(new_word + variant_p->word_len - rule_p->from_len,
+					rule_p->to, rule_p->to_len);
 				
-				old_variant_pos = vector_find(variants, &variant,
-					&find_variant);
-				old_variant = vector_get(variants, old_variant_pos);
-				if (old_variant != NULL) {
-					old_variant->type |= (rule_p->type >> 8);
-					vector_set(variants, old_variant_pos, old_variant);
-					free(old_variant);
-					free(variant.word);
-				} else {
-					variant.reason = concatenate_reasons(variant_p->reason,
-						rule_p->reason);
+				word.word = variants->words_len;
+				word.len = variant.word_len;
+				old_variant_pos = word_map_get(variant_words, word);
+				if (old_variant_pos != NULL)
+					variants->variants->data[*old_variant_pos].type |=
+						(rule_p->type >> 8);
+				else {
+					variant.word = variants->words_len;
+					variants->words_len += variant.word_len;
+					variant.parent = pos_v - 1;
+					variant.rule = pos_r - 1;
 					variant.type = rule_p->type >> 8;
+					variant.expanded = 0;
+					word_map_set(variant_words, word,
+						jpn_variant_vector_length(variants->variants));
 					
 					/* Append new variant and update variant_p. */
-					vector_append(variants, &variant);
-					variant_p = vector_get_const(variants, pos_v - 1);
+					jpn_variant_vector_append(variants->variants, variant);
+					variant_p = jpn_variant_vector_get(variants->variants,
+						pos_v - 1);
 				}
 			}
 			
 		}
 	}
 	
+	word_map_destroy(variant_words);
 	g_free(text2);
 	return variants;
 }
 
-void jpn_variants_destroy(Vector *variants) {
-	const Variant *variant;
-	size_t pos = 0;
+void jpn_variants_destroy(jpn_Variants *variants) {
+	jpn_variant_vector_destroy(variants->variants);
+	free(variants->words);
+	free(variants);
+}
+
+const char *jpn_variant_word(const jpn_Variants *variants,
+	const jpn_Variant *variant) {
+	return variants->words + variant->word;
+}
+
+char *jpn_variant_reason(const jpn_Variants *variants,
+	const jpn_Variant *variant, jpn_Rule_vector *rules) {
+	const Rule *rule;
+	char *old_reason, *reason;
 	
-	while ((variant = vector_get_const(variants, pos++))) {
-		free(variant->reason);
-		free(variant->word);
-	}
-	vector_destroy(variants);
+	if (variant->rule < 0)
+		return NULL;
+	
+	/* Reasons are read from the last applied rule back to the original word */
+	rule = jpn_rule_vector_get(rules, variant->rule);
+	old_reason = jpn_variant_reason(variants,
+		jpn_variant_vector_get(variants->variants, variant->parent), rules);
+	reason = concatenate_reasons(old_reason, rule->reason);
+	free(old_reason);
+	
+	return reason;
 }
 
 char *jpn_half2fullwidth(const char *str) {
@@ -327,30 +484,32 @@ char *jpn_katakana2hiragana(const char *str) {
 	return result;
 }
 
-int jpn_is_correctly_deinflected(int type, const char* pos) {
+int jpn_pos_types(const char* pos) {
 	char *pos_, *p_pos, *p_pos2;
-	int r;
+	int types = 0;
 	
 	p_pos2 = p_pos = pos_ = strdup(pos);
 	do {
 		p_pos2 = string_split_string(p_pos2, "; ");
-		r = (type == 0xFF)
-			|| ((type & 1) && (strcmp(p_pos, "v1") == 0))
-			|| ((type & 4) && (strcmp(p_pos, "adj-i") == 0))
-			|| ((type & 64) && (strcmp(p_pos, "v5k-s") == 0
-				|| strcmp(p_pos, "v5u-s") == 0 ))
-			|| ((type & 2) && (strcmp(p_pos, "v5k-s") != 0
-				&& strcmp(p_pos, "v5u-s") != 0 && strncmp(p_pos, "v5", 2) == 0))
-			|| ((type & 8) && (strcmp(p_pos, "vk") == 0))
-			|| ((type & 16) && (strncmp(p_pos, "vs-", 3) == 0));
-		
-		if (r) {
-			free(pos_);
-			return 1;
-		}
+		if (strcmp(p_pos, "v1") == 0)
+			types |= 1;
+		else if (strcmp(p_pos, "adj-i") == 0)
+			types |= 4;
+		else if (strcmp(p_pos, "v5k-s") == 0 || strcmp(p_pos, "v5u-s") == 0)
+			types |= 64;
+		else if (strncmp(p_pos, "v5", 2) == 0)
+			types |= 2;
+		else if (strcmp(p_pos, "vk") == 0)
+			types |= 8;
+		else if (strncmp(p_pos, "vs-", 3) == 0)
+			types |= 16;
 		p_pos = p_pos2;
 	} while (p_pos);
 	
 	free(pos_);
-	return 0;
+	return types;
+}
+
+int jpn_is_correctly_deinflected(int type, const char* pos) {
+	return (type == 0xFF) || (type & jpn_pos_types(pos));
 }
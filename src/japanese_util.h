@@ -17,6 +17,9 @@
  * along with JpnCap.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#pragma once
+
+#include <stdint.h>
 #include "vector.h"
 
 typedef struct {
@@ -28,16 +31,64 @@ typedef struct {
 	char* reason;
 } jpn_Rule;
 
+VECTOR_DEFINE(jpn_Rule_vector, jpn_rule_vector, jpn_Rule)
+
+/** A deinflected variant of a word. Its bytes are stored in the words buffer
+	of the jpn_Variants it belongs to and are not null terminated. A variant
+	that was derived by applying a rule refers to the variant it was derived
+	from, so the reason can be reconstructed if needed.
+	expanded holds the types the rules have already been tried with.
+*/
 typedef struct {
-	char *word;
+	size_t word;
+	size_t word_len;
+	int parent;
+	int rule;
 	int type;
-	char *reason;
+	int expanded;
 } jpn_Variant;
 
-Vector *jpn_deinflect_load(const char *file_path);
-void jpn_rules_destroy(Vector *rules);
-Vector *jpn_get_all_variants(const char *text, Vector *rules);
-void jpn_variants_destroy(Vector *variants);
+VECTOR_DEFINE(jpn_Variant_vector, jpn_variant_vector, jpn_Variant)
+
+/** Variants are ordered by the length of the original text they were derived
+	from, longest first, and then by the number of rules applied. If the
+	budget of the search ran out, truncated is set and only the variants found
+	until then are included.
+*/
+typedef struct {
+	jpn_Variant_vector *variants;
+	char *words;
+	size_t words_len;
+	size_t words_capacity;
+	int truncated;
+} jpn_Variants;
+
+/** Limits the work spent on finding variants of a text. max_work is the
+	number of rule tests and max_time is in microseconds. A limit of 0 means
+	that there is no limit.
+*/
+typedef struct {
+	size_t max_work;
+	int64_t max_time;
+} jpn_Budget;
+
+/** Returns whether any word of a dictionary starts with the len bytes at
+	prefix.
+*/
+typedef int (*jpn_Prefix_func)(const char *prefix, size_t len, void *data);
+
+jpn_Rule_vector *jpn_deinflect_load(const char *file_path);
+void jpn_rules_destroy(jpn_Rule_vector *rules);
+jpn_Variants *jpn_get_all_variants(const char *text,
+	jpn_Rule_vector *rules,
+	jpn_Prefix_func has_prefix, void *prefix_data, size_t max_work,
+	int64_t deadline);
+void jpn_variants_destroy(jpn_Variants *variants);
+const char *jpn_variant_word(const jpn_Variants *variants,
+	const jpn_Variant *variant);
+char *jpn_variant_reason(const jpn_Variants *variants,
+	const jpn_Variant *variant, jpn_Rule_vector *rules);
 char *jpn_half2fullwidth(const char *str);
 char *jpn_katakana2hiragana(const char *str);
+int jpn_pos_types(const char* pos);
 int jpn_is_correctly_deinflected(int type, const char* pos);
@@ -23,9 +23,9 @@
 #include <gdk/gdk.h>
 #include <glib.h>
 #include <locale.h>
-#include <tesseract/capi.h>
 
 #include "recognize.h"
+#include "ocr_pool.h"
 #include "dictionary.h"
 #include "vector.h"
 #include "japanese_util.h"
@@ -33,75 +33,247 @@
 
 #include "configuration.h"
 
+/* Resources loaded on worker threads while the window is shown */
+enum {
+	STARTUP_DEINFLECT,
+	STARTUP_DICTIONARY,
+	STARTUP_SUBSTITUTIONS,
+	STARTUP_OCR_CACHE,
+	STARTUP_LOADERS_LENGTH
+};
+
+typedef struct {
+	const char *name;
+	const char *file_name;
+	gpointer (*load)(const char *file_name, gpointer data);
+	/* Whether jpncap cannot run without it */
+	int required;
+	gpointer data;
+	gpointer result;
+	/* Microseconds the loading took and after which the result was handed
+		to the window, counted from the start */
+	gint64 load_time;
+	gint64 ready_time;
+} Startup_loader;
+
+typedef struct {
+	main_window *mw;
+	Startup_loader loaders[STARTUP_LOADERS_LENGTH];
+	int pending;
+	gint64 start;
+	int status;
+	/* Whether recognized texts are saved and loaded again on the next start */
+	int keep_ocr_cache;
+} Startup;
+
+static gpointer load_deinflect(const char *file_name, gpointer data) {
+	return jpn_deinflect_load(file_name);
+}
+
+/** Also loads the headword indices, so that the first lookup does not have
+	to.
+*/
+static gpointer load_dictionary(const char *file_name, gpointer data) {
+	Dictionary *dict;
+	
+	if ((dict = dictionary_load(file_name)) != NULL)
+		dictionary_load_indices(dict);
+	return dict;
+}
+
+static gpointer load_substitutions(const char *file_name, gpointer data) {
+	return substitutions_load(file_name);
+}
+
+/** Adds the saved texts to the cache in data, which the pool already uses.
+*/
+static gpointer load_ocr_cache(const char *file_name, gpointer data) {
+	return ocr_cache_load((Ocr_cache*)data, file_name) == 0 ? data : NULL;
+}
+
+static void startup_load(GTask *task, gpointer source, gpointer task_data,
+	GCancellable *cancellable) {
+	Startup_loader *loader = (Startup_loader*)task_data;
+	gint64 start = g_get_monotonic_time();
+	
+	loader->result = loader->load(loader->file_name, loader->data);
+	loader->load_time = g_get_monotonic_time() - start;
+	g_task_return_boolean(task, TRUE);
+}
+
+/** Hands the result of loader to the window or quits if it is missing.
+*/
+static void startup_hand_over(Startup *startup, Startup_loader *loader) {
+	Startup_loader *loaders = startup->loaders;
+	
+	if (loader->result == NULL && loader->required) {
+		fprintf(stderr, "Could not load the %s from %s\n", loader->name,
+			loader->file_name);
+		startup->status = 1;
+		g_application_quit(G_APPLICATION(startup->mw->app));
+	} else if (loader == loaders + STARTUP_SUBSTITUTIONS) {
+		mw_set_substitutions(startup->mw, loader->result);
+	} else if (loader == loaders + STARTUP_OCR_CACHE) {
+		/* The pool has looked texts up in the cache all along */
+	} else if (loaders[STARTUP_DEINFLECT].ready_time != 0
+		&& loaders[STARTUP_DICTIONARY].ready_time != 0
+		&& startup->status == 0) {
+		
+		/* Words are looked up once both are there */
+		mw_set_dictionary(startup->mw, loaders[STARTUP_DICTIONARY].result,
+			loaders[STARTUP_DEINFLECT].result);
+	}
+}
+
+static void startup_loaded(GObject *source, GAsyncResult *result,
+	gpointer pdata) {
+	Startup *startup = (Startup*)pdata;
+	Startup_loader *loader;
+	int i;
+	
+	loader = g_task_get_task_data(G_TASK(result));
+	loader->ready_time = g_get_monotonic_time() - startup->start;
+	startup->pending--;
+	/* The window is gone if it was closed before everything was loaded */
+	if (startup->mw != NULL)
+		startup_hand_over(startup, loader);
+	
+	if (startup->pending > 0)
+		return;
+	for (i = 0; i < STARTUP_LOADERS_LENGTH; i++)
+		if (startup->loaders[i].ready_time != 0)
+			g_debug("startup: %s loaded in %.1f ms, ready after %.1f ms",
+				startup->loaders[i].name,
+				startup->loaders[i].load_time / 1000.0,
+				startup->loaders[i].ready_time / 1000.0);
+}
+
+/** Starts loading the resources once it is clear that this is the primary
+	instance, so that the window can be shown while they load.
+*/
+static void startup_start(GApplication *app, gpointer pdata) {
+	Startup *startup = (Startup*)pdata;
+	GTask *task;
+	int i;
+	
+	for (i = 0; i < STARTUP_LOADERS_LENGTH; i++) {
+		if (i == STARTUP_OCR_CACHE && !startup->keep_ocr_cache)
+			continue;
+		task = g_task_new(NULL, NULL, startup_loaded, startup);
+		g_task_set_task_data(task, startup->loaders + i, NULL);
+		g_task_run_in_thread(task, startup_load);
+		g_object_unref(task);
+		startup->pending++;
+	}
+}
+
+static void startup_shown(GApplication *app, gpointer pdata) {
+	Startup *startup = (Startup*)pdata;
+	
+	g_debug("startup: window shown after %.1f ms",
+		(g_get_monotonic_time() - startup->start) / 1000.0);
+}
+
+static gint handle_local_options(GApplication *app, GVariantDict *options,
+	gpointer pdata) {
+	Startup *startup = (Startup*)pdata;
+	
+	/* GLib reads this whenever a debug message is logged */
+	if (g_variant_dict_contains(options, "debug"))
+		g_setenv("G_MESSAGES_DEBUG", "all", TRUE);
+	startup->keep_ocr_cache = g_variant_dict_contains(options,
+		"keep-ocr-cache");
+	return -1;
+}
+
 int main(int argc, char **argv) {
 	GtkApplication *app;
 	main_window *mw;
-	TessBaseAPI *TesseractHandle;
-	Vector *substitutions;
-	Vector *deinflect_rules;
-	Dictionary *dictionary;
-	int status = 0;
+	Ocr_pool *ocr_pool;
+	Ocr_cache *ocr_cache;
+	char *ocr_cache_dir, *ocr_cache_file;
+	Startup startup = {
+		NULL,
+		{
+			{"deinflect rules", JPNCAP_RESOURCES_PATH "/deinflect.txt",
+				load_deinflect, 1},
+			{"dictionary", JPNCAP_RESOURCES_PATH "/dict.db",
+				load_dictionary, 1},
+			{"substitutions", JPNCAP_RESOURCES_PATH "/substitutions.txt",
+				load_substitutions, 0},
+			{"OCR cache", NULL, load_ocr_cache, 0}
+		},
+		0, 0, 0, 0
+	};
+	int status;
 
+	startup.start = g_get_monotonic_time();
 	/* Tesseract needs this setlocale call on non English platforms */
 	setlocale(LC_NUMERIC, "C");
-	TesseractHandle = TessBaseAPICreate();
-	if (TessBaseAPIInit3(TesseractHandle, NULL, "jpn+jpn_vert") != 0) {
-		fprintf(stderr, "Could not initiate tesseract. Please check if "
-			"tesseract and its Japanese components are installed "
-			"properly.\n");
-		status = 1;
-		goto cleanup_a;
-	}
-	if ((deinflect_rules =
-		jpn_deinflect_load(JPNCAP_RESOURCES_PATH "/deinflect.txt"))
-			== NULL) {
-		
-		fprintf(stderr, "Could not load the deinflect rules from %s\n",
-			JPNCAP_RESOURCES_PATH "/deinflect.txt");
-		status = 1;
-		goto cleanup_b;
-	}
-	if ((dictionary =
-		dictionary_load(JPNCAP_RESOURCES_PATH "/dict.db")) == NULL) {
-		
-		fprintf(stderr, "Could not load the dictionary from %s\n",
-			JPNCAP_RESOURCES_PATH "/dict.db");
-		status = 1;
-		goto cleanup_c;
-	}
-	/*
-	if ((substitutions = substitutions_load(RESOURCES_PATH "/substitutions.txt")) == NULL) {
-		perror("Unable to open subsitutions file");
-		status = 1;
-		goto cleanup_d;
-	}
-	* */
-	substitutions = substitutions_load(JPNCAP_RESOURCES_PATH "/substitutions.txt");
+	/* The pool is destroyed before the substitutions its recognitions use.
+		Tesseract is initialized in the background when the window sets the
+		text orientation. */
+	ocr_cache_dir = g_build_filename(g_get_user_cache_dir(), "jpncap", NULL);
+	ocr_cache_file = g_build_filename(ocr_cache_dir, "ocr-cache", NULL);
+	/* The saved texts are added to the cache while the window is shown if
+		they are kept */
+	ocr_cache = ocr_cache_create(OCR_CACHE_SIZE);
+	startup.loaders[STARTUP_OCR_CACHE].file_name = ocr_cache_file;
+	startup.loaders[STARTUP_OCR_CACHE].data = ocr_cache;
+	ocr_pool = ocr_pool_create(MIN(OCR_POOL_SIZE_MAX,
+		g_get_num_processors()), ocr_cache);
 
 	app = gtk_application_new("nodomain.jpncap", G_APPLICATION_FLAGS_NONE);
+	g_application_add_main_option(G_APPLICATION(app), "debug", 0, 0,
+		G_OPTION_ARG_NONE, "Print how long startup and recognitions take",
+		NULL);
+	g_application_add_main_option(G_APPLICATION(app), "keep-ocr-cache", 0, 0,
+		G_OPTION_ARG_NONE, "Save the recognized texts and find them again "
+		"after a restart", NULL);
 	mw = malloc(sizeof(*mw));
 	mw->app = app;
-	mw->tess_handle = TesseractHandle;
-	mw->substitutions = substitutions;
-	mw->deinflect_rules = deinflect_rules;
-	mw->dictionary = dictionary;
+	mw->window = NULL;
+	mw->ocr_pool = ocr_pool;
+	mw->substitutions = NULL;
+	mw->deinflect_rules = NULL;
+	mw->dictionary = NULL;
+	startup.mw = mw;
+	g_signal_connect(app, "handle-local-options",
+		G_CALLBACK(handle_local_options), &startup);
 	g_signal_connect(app, "activate", G_CALLBACK(create_main_window), mw);
+	g_signal_connect_after(app, "activate", G_CALLBACK(startup_shown),
+		&startup);
+	g_signal_connect(app, "startup", G_CALLBACK(startup_start), &startup);
 	g_signal_connect(app, "startup", G_CALLBACK(startup_main_window), mw);
 	g_signal_connect(app, "shutdown", G_CALLBACK(shutdown_main_window), mw);
 	status = g_application_run(G_APPLICATION(app), argc, argv);
+	/* The widgets are gone, so no more recognitions may be delivered to the
+		window while the loaders are waited for below */
+	ocr_pool_destroy(ocr_pool);
+	/* Loaders still running when the window was closed are waited for,
+		which also keeps the cache from being saved while it is loaded */
+	startup.mw = NULL;
+	while (startup.pending > 0)
+		g_main_context_iteration(NULL, TRUE);
+	if (startup.status != 0)
+		status = startup.status;
 
 	free(mw);
 	g_object_unref(app);
 	
-	substitutions_destroy(substitutions);
-	/* cleanup_d: */
-	dictionary_destroy(dictionary);
-	cleanup_c:
-	jpn_rules_destroy(deinflect_rules);
-	cleanup_b:
-	TessBaseAPIEnd(TesseractHandle);
-	TessBaseAPIDelete(TesseractHandle);
-	cleanup_a:
+	if (startup.keep_ocr_cache) {
+		g_mkdir_with_parents(ocr_cache_dir, 0700);
+		ocr_cache_save(ocr_cache, ocr_cache_file);
+	}
+	ocr_cache_destroy(ocr_cache);
+	g_free(ocr_cache_file);
+	g_free(ocr_cache_dir);
+	if (startup.loaders[STARTUP_SUBSTITUTIONS].result != NULL)
+		substitutions_destroy(startup.loaders[STARTUP_SUBSTITUTIONS].result);
+	if (startup.loaders[STARTUP_DICTIONARY].result != NULL)
+		dictionary_destroy(startup.loaders[STARTUP_DICTIONARY].result);
+	if (startup.loaders[STARTUP_DEINFLECT].result != NULL)
+		jpn_rules_destroy(startup.loaders[STARTUP_DEINFLECT].result);
 	
 	return status;
 }
@@ -34,6 +34,8 @@
 const char SHORT_HELP[] = "Type text into the field above or use the Capture "
 	"button to detect text from the screen.\nThen move the text cursor in front"
 	" of a word to lookup.";
+const char LOOKUP_TRUNCATED[] = "\n(The lookup was stopped early, there may be "
+	"more results.)";
 
 static void history_back(GtkButton* button, gpointer pdata) {
 	main_window* mw = (main_window*)pdata;
@@ -124,6 +126,68 @@ static void orientation_set_state(GSimpleAction* action, GVariant* state,
 	else
 		fprintf(stderr, "orientation_set_state: Unknown orientation %s\n",
 			orientation);
+	ocr_pool_preload(mw->ocr_pool, mw->setting_orientation);
+}
+
+static void profile_callback(GSimpleAction* action, GVariant* parameter,
+	gpointer pdata) {
+	g_action_change_state(G_ACTION(action), parameter);
+}
+
+static void profile_set_state(GSimpleAction* action, GVariant* state,
+	gpointer pdata) {
+	main_window *mw = (main_window*)pdata;
+	const char *name = g_variant_get_string(state, NULL);
+	const ocr_pool_Profile *profile;
+	int i;
+	
+	for (i = 0; i < OCR_PROFILES_LENGTH; i++) {
+		profile = ocr_pool_get_profile(i);
+		if (strcmp(name, profile->name) == 0)
+			break;
+	}
+	if (i == OCR_PROFILES_LENGTH) {
+		fprintf(stderr, "profile_set_state: Unknown profile %s\n", name);
+		return;
+	}
+	g_simple_action_set_state(action, state);
+	
+	mw->setting_profile = i;
+	mw->setting_preprocess.glyph_height = profile->glyph_height;
+	ocr_pool_set_profile(mw->ocr_pool, mw->setting_profile);
+	ocr_pool_preload(mw->ocr_pool, mw->setting_orientation);
+}
+
+static void progressive_callback(GSimpleAction* action, GVariant *parameter,
+	gpointer pdata) {
+	GVariant *state = g_action_get_state(G_ACTION(action));
+	g_action_change_state(G_ACTION(action),
+		g_variant_new_boolean(!g_variant_get_boolean(state)));
+	g_variant_unref(state);
+}
+
+static void progressive_set_state(GSimpleAction* action, GVariant* state,
+	gpointer pdata) {
+	main_window *mw = (main_window*)pdata;
+
+	g_simple_action_set_state(action, state);
+	mw->setting_progressive = g_variant_get_boolean(state);
+	ocr_pool_set_progressive(mw->ocr_pool, mw->setting_progressive);
+	ocr_pool_preload(mw->ocr_pool, mw->setting_orientation);
+}
+
+static void deadline_callback(GSimpleAction* action, GVariant* parameter,
+	gpointer pdata) {
+	g_action_change_state(G_ACTION(action), parameter);
+}
+
+static void deadline_set_state(GSimpleAction* action, GVariant* state,
+	gpointer pdata) {
+	main_window *mw = (main_window*)pdata;
+
+	g_simple_action_set_state(action, state);
+	mw->setting_ocr_deadline = g_variant_get_int32(state);
+	ocr_pool_set_deadline(mw->ocr_pool, mw->setting_ocr_deadline);
 }
 
 static void remove_whitespaces_callback(GSimpleAction* action,
@@ -142,28 +206,261 @@ static void remove_whitespaces_set_state(GSimpleAction* action, GVariant* state,
 	mw->setting_remove_whitespaces = g_variant_get_boolean(state);
 }
 
+static void preprocess_callback(GSimpleAction* action, GVariant *parameter,
+	gpointer pdata) {
+	GVariant *state = g_action_get_state(G_ACTION(action));
+	g_action_change_state(G_ACTION(action),
+		g_variant_new_boolean(!g_variant_get_boolean(state)));
+	g_variant_unref(state);
+}
+
+static void preprocess_set_state(GSimpleAction* action, GVariant* state,
+	gpointer pdata) {
+	main_window *mw = (main_window*)pdata;
+
+	g_simple_action_set_state(action, state);
+	mw->setting_preprocess.enabled = g_variant_get_boolean(state);
+}
+
+static void freeze_callback(GSimpleAction* action, GVariant *parameter,
+	gpointer pdata) {
+	GVariant *state = g_action_get_state(G_ACTION(action));
+	g_action_change_state(G_ACTION(action),
+		g_variant_new_boolean(!g_variant_get_boolean(state)));
+	g_variant_unref(state);
+}
+
+static void freeze_set_state(GSimpleAction* action, GVariant* state,
+	gpointer pdata) {
+	main_window *mw = (main_window*)pdata;
+
+	g_simple_action_set_state(action, state);
+	mw->setting_freeze = g_variant_get_boolean(state);
+}
+
+static void watch_capture_callback(GdkPixbuf* pixbuf, const GdkRectangle *rect,
+	gpointer pdata);
+
+/** Stops watching and starts again if watching is on and there is an area to
+	watch, e.g. after it or the interval changed. recognized is the capture of
+	the area that was just recognized or NULL, which is only recognized again
+	once it changes.
+*/
+static void watch_update(main_window *mw, GdkPixbuf *recognized) {
+	if (mw->watch != NULL) {
+		capture_watch_stop(mw->watch);
+		mw->watch = NULL;
+	}
+	if (mw->setting_watch && mw->last_rect_valid)
+		mw->watch = capture_watch_start(&mw->last_rect,
+			mw->setting_watch_interval, recognized, &watch_capture_callback,
+			mw);
+}
+
+static void watch_callback(GSimpleAction* action, GVariant *parameter,
+	gpointer pdata) {
+	GVariant *state = g_action_get_state(G_ACTION(action));
+	g_action_change_state(G_ACTION(action),
+		g_variant_new_boolean(!g_variant_get_boolean(state)));
+	g_variant_unref(state);
+}
+
+static void watch_set_state(GSimpleAction* action, GVariant* state,
+	gpointer pdata) {
+	main_window *mw = (main_window*)pdata;
+
+	g_simple_action_set_state(action, state);
+	mw->setting_watch = g_variant_get_boolean(state);
+	watch_update(mw, NULL);
+}
+
+static void watch_interval_callback(GSimpleAction* action,
+	GVariant* parameter, gpointer pdata) {
+	g_action_change_state(G_ACTION(action), parameter);
+}
+
+static void watch_interval_set_state(GSimpleAction* action, GVariant* state,
+	gpointer pdata) {
+	main_window *mw = (main_window*)pdata;
+
+	g_simple_action_set_state(action, state);
+	mw->setting_watch_interval = g_variant_get_int32(state);
+	watch_update(mw, NULL);
+}
+
 static void language_callback(GSimpleAction* action, GVariant* parameter,
 	gpointer pdata) {
 	g_action_change_state(G_ACTION(action), parameter);
 }
 
-static void capture_callback(GdkPixbuf* pixbuf, gpointer pdata) {
+static gboolean progress_update(gpointer pdata) {
+	main_window *mw = (main_window*)pdata;
+	int progress = ocr_pool_get_progress(mw->ocr_pool, mw->ocr_last_id);
+	
+	if (progress >= 0)
+		gtk_progress_bar_set_fraction(GTK_PROGRESS_BAR(mw->progress_bar),
+			progress / 100.0);
+	return G_SOURCE_CONTINUE;
+}
+
+static void progress_stop(main_window *mw) {
+	if (mw->progress_source_id == 0)
+		return;
+	g_source_remove(mw->progress_source_id);
+	mw->progress_source_id = 0;
+	gtk_widget_hide(mw->progress_bar);
+}
+
+static int mw_history_add(main_window* mw, const char* text);
+static void mw_history_replace_last(main_window *mw, const char *text);
+
+static void recognize_callback(char *text, guint id, int final,
+	gpointer pdata) {
+	main_window *mw = (main_window*)pdata;
+
+	if (final && id == mw->ocr_last_id)
+		progress_stop(mw);
+	/* Results of earlier captures that took longer are outdated. A
+		preliminary text is replaced by the final one in place, unless it
+		did not make it into the history. */
+	if (text != NULL && id > mw->ocr_shown_id) {
+		if (mw_history_add(mw, text) || final) {
+			mw->ocr_shown_id = id;
+			mw->ocr_shown_preliminary = !final;
+		}
+		mw_history_move(mw, MAIN_WINDOW_HISTORY_ENTRIES_MAX);
+	} else if (text != NULL && final && id == mw->ocr_shown_id
+		&& mw->ocr_shown_preliminary) {
+		mw->ocr_shown_preliminary = FALSE;
+		mw_history_replace_last(mw, text);
+	}
+	free(text);
+}
+
+static void recognize_capture(main_window *mw, GdkPixbuf *pixbuf) {
+	/* A new capture replaces those still being recognized */
+	ocr_pool_cancel(mw->ocr_pool, mw->ocr_last_id);
+	mw->ocr_last_id = ocr_pool_recognize(mw->ocr_pool, pixbuf, NULL,
+		&mw->setting_preprocess, mw->setting_orientation,
+		mw->setting_remove_whitespaces, mw->substitutions,
+		&recognize_callback, mw);
+	gtk_progress_bar_set_fraction(GTK_PROGRESS_BAR(mw->progress_bar), 0);
+	gtk_widget_show(mw->progress_bar);
+	if (mw->progress_source_id == 0)
+		mw->progress_source_id = g_timeout_add(MAIN_WINDOW_PROGRESS_INTERVAL,
+			progress_update, mw);
+}
+
+static void capture_callback(GdkPixbuf* pixbuf, const GdkRectangle *rect,
+	gpointer pdata) {
 	main_window *mw = (main_window*)pdata;
-	char *processed_text;
 
 	gtk_widget_set_sensitive(mw->button, TRUE);
 	
+	/* The capture holds only the selection, rect is where it was on the
+		screen and is watched from now on */
 	if (pixbuf != NULL) {
-		processed_text = processPixbuf(pixbuf, mw->setting_orientation,
-			mw->setting_remove_whitespaces, mw->tess_handle, mw->substitutions);
-		updateTextViews(mw, processed_text);
-		free(processed_text);
+		mw->last_rect = *rect;
+		mw->last_rect_valid = TRUE;
+		recognize_capture(mw, pixbuf);
 	}
+	watch_update(mw, pixbuf);
+}
+
+static void watch_capture_callback(GdkPixbuf* pixbuf, const GdkRectangle *rect,
+	gpointer pdata) {
+	recognize_capture((main_window*)pdata, pixbuf);
 }
 
 static void capture_button_callback(GtkWidget* widget, gpointer pdata) {
+	main_window *mw = (main_window*)pdata;
+
 	gtk_widget_set_sensitive(widget, FALSE);
-	capture(&capture_callback, pdata);
+	/* The watched area is not read while the rubberband may be on it */
+	if (mw->watch != NULL) {
+		capture_watch_stop(mw->watch);
+		mw->watch = NULL;
+	}
+	capture(mw->setting_freeze, &capture_callback, pdata);
+}
+
+/** Recognizes the area rect of the screen right away, which becomes the area
+	captured last.
+*/
+static void capture_rect(main_window *mw, const GdkRectangle *rect) {
+	GdkPixbuf *pixbuf;
+	
+	/* The user is selecting an area */
+	if (!gtk_widget_get_sensitive(mw->button))
+		return;
+	if ((pixbuf = capture_area(rect)) == NULL) {
+		fprintf(stderr, "capture_rect: The area %dx%d%+d%+d is off the "
+			"screen\n", rect->width, rect->height, rect->x, rect->y);
+		return;
+	}
+	mw->last_rect = *rect;
+	mw->last_rect_valid = TRUE;
+	recognize_capture(mw, pixbuf);
+	watch_update(mw, pixbuf);
+	g_object_unref(pixbuf);
+}
+
+static void recapture_callback(GSimpleAction* action, GVariant* parameter,
+	gpointer pdata) {
+	main_window *mw = (main_window*)pdata;
+	
+	if (mw->last_rect_valid)
+		capture_rect(mw, &mw->last_rect);
+}
+
+static void capture_region_callback(GSimpleAction* action,
+	GVariant* parameter, gpointer pdata) {
+	main_window *mw = (main_window*)pdata;
+	const char *name = g_variant_get_string(parameter, NULL);
+	GdkRectangle rect;
+	GError *error = NULL;
+	
+	rect.x = g_key_file_get_integer(mw->regions, name, "x", &error);
+	if (error == NULL)
+		rect.y = g_key_file_get_integer(mw->regions, name, "y", &error);
+	if (error == NULL)
+		rect.width = g_key_file_get_integer(mw->regions, name, "width",
+			&error);
+	if (error == NULL)
+		rect.height = g_key_file_get_integer(mw->regions, name, "height",
+			&error);
+	if (error != NULL) {
+		fprintf(stderr, "capture_region_callback: No area %s: %s\n", name,
+			error->message);
+		g_error_free(error);
+		return;
+	}
+	capture_rect(mw, &rect);
+}
+
+static void save_region_callback(GSimpleAction* action, GVariant* parameter,
+	gpointer pdata) {
+	main_window *mw = (main_window*)pdata;
+	const char *name = g_variant_get_string(parameter, NULL);
+	GError *error = NULL;
+	char *dir;
+	
+	if (!mw->last_rect_valid)
+		return;
+	g_key_file_set_integer(mw->regions, name, "x", mw->last_rect.x);
+	g_key_file_set_integer(mw->regions, name, "y", mw->last_rect.y);
+	g_key_file_set_integer(mw->regions, name, "width", mw->last_rect.width);
+	g_key_file_set_integer(mw->regions, name, "height",
+		mw->last_rect.height);
+	
+	dir = g_path_get_dirname(mw->regions_file);
+	g_mkdir_with_parents(dir, 0700);
+	g_free(dir);
+	if (!g_key_file_save_to_file(mw->regions, mw->regions_file, &error)) {
+		fprintf(stderr, "save_region_callback: Could not save %s: %s\n",
+			mw->regions_file, error->message);
+		g_error_free(error);
+	}
 }
 
 static char *find_good_lookup_position(char *text, int start_pos) {
@@ -200,11 +497,13 @@ static void update_dict_view(GtkTextBuffer* raw_buffer, GParamSpec *pspec,
 	static char last_lookup[61];
 	static dictionary_Language last_lang;
 	GtkTextBuffer *dict_buffer;
-	int pos;
+	int pos, truncated;
 	GtkTextIter start, end;
 	char *text, *text_lookup, *dict_entry;
 	size_t len;
 	
+	if (mw->dictionary == NULL)
+		return;
 	g_object_get(raw_buffer, "cursor-position", &pos, NULL);
 	gtk_text_buffer_get_start_iter(raw_buffer, &start);
 	gtk_text_buffer_get_end_iter(raw_buffer, &end);
@@ -224,7 +523,8 @@ static void update_dict_view(GtkTextBuffer* raw_buffer, GParamSpec *pspec,
 	strncpy(last_lookup, text_lookup, 60);
 	last_lang = mw->setting_language;
 	dict_entry = dictionary_lookup(mw->dictionary, text_lookup,
-		&(mw->setting_language), mw->deinflect_rules);
+		&(mw->setting_language), mw->deinflect_rules,
+		&(mw->setting_lookup_budget), &truncated);
 	g_free(text);
 	if (dict_entry == NULL) {
 		fprintf(stderr, "Failed to lookup word.\n");
@@ -233,24 +533,18 @@ static void update_dict_view(GtkTextBuffer* raw_buffer, GParamSpec *pspec,
 	
 	dict_buffer = gtk_text_view_get_buffer(GTK_TEXT_VIEW(mw->dict_text_view));
 	gtk_text_buffer_set_text(dict_buffer, dict_entry, strlen(dict_entry));
+	if (truncated) {
+		gtk_text_buffer_get_end_iter(dict_buffer, &end);
+		gtk_text_buffer_insert(dict_buffer, &end, LOOKUP_TRUNCATED,
+			strlen(LOOKUP_TRUNCATED));
+	}
 	free(dict_entry);
 }
 
-static int find_selected_language(const void* a, const void* b, size_t n) {
-	const dictionary_Language *lang = (const dictionary_Language*)a;
-	const char *lang_str = (const char*)b;
-	size_t len = strlen(lang->table_name);
-	
-	if (memcmp(lang_str, lang->table_name, len) == 0
-		&& strcmp(lang_str + len, lang->column_name) == 0)
-		return 0;
-	return 1;
-}
-
 static void language_set_state(GSimpleAction* action, GVariant* state,
 	gpointer pdata) {
 	main_window *mw = (main_window*)pdata;
-	size_t pos;
+	const dictionary_Language *lang;
 	const char *language = g_variant_get_string(state, NULL);
 	
 	if (mw->dictionary == NULL)
@@ -258,14 +552,11 @@ static void language_set_state(GSimpleAction* action, GVariant* state,
 
 	g_simple_action_set_state(action, state);
 	
-	pos = vector_find(mw->dictionary->languages, language,
-		find_selected_language);
-	if (pos == vector_length(mw->dictionary->languages))
+	if ((lang = dictionary_find_language(mw->dictionary, language)) == NULL)
 		fprintf(stderr, "language_set_state: Unknown language %s\n",
 			language);
 	else
-		mw->setting_language = *(const dictionary_Language*)vector_get_const(
-			mw->dictionary->languages, pos);
+		mw->setting_language = *lang;
 			
 	update_dict_view(gtk_text_view_get_buffer(GTK_TEXT_VIEW(mw->raw_text_view)),
 		NULL, mw);
@@ -278,7 +569,8 @@ static void language_set(main_window *mw, unsigned int n) {
 	if (mw->dictionary == NULL)
 		return;
 	
-	if ((lang = vector_get_const(mw->dictionary->languages, n)) == NULL)
+	if ((lang = dictionary_language_vector_get(mw->dictionary->languages, n))
+		== NULL)
 		return;
 	asprintf(&state_str, "%s%s", lang->table_name, lang->column_name);
 	
@@ -311,23 +603,42 @@ static gboolean on_key_release(GtkWidget *widget, GdkEventKey *event,
 		for (i = 0; F_KEYS[i] != event->keyval; i++);
 		language_set(mw, i);
 		return TRUE;
+	case GDK_KEY_Escape:
+		if (mw->progress_source_id == 0)
+			return FALSE;
+		ocr_pool_cancel(mw->ocr_pool, mw->ocr_last_id);
+		return TRUE;
 	default:
 		return FALSE;
 	}
 }
 
+static void mw_add_languages(main_window *mw) {
+	const dictionary_Language *lang;
+	char *detail_string;
+	size_t pos = 0;
+	
+	while ((lang = dictionary_language_vector_get(mw->dictionary->languages,
+		pos++))) {
+		asprintf(&detail_string, "app.language::%s%s", lang->table_name,
+			lang->column_name);
+		g_menu_append(mw->menu_language, lang->display_name, detail_string);
+		free(detail_string);
+	}
+}
+
 void create_main_window(GtkApplication* app, gpointer pdata) {
 	main_window *mw;
 	GtkTextBuffer *raw_buffer;
 	GtkTextBuffer *dict_buffer;
 	
-	size_t pos;
-	const dictionary_Language *lang;
-	char *detail_string;
+	char *detail_string, *label;
+	int i;
 	
 	GtkStyleContext *style_context;
-	GMenu *menu_auto_clipboard, *menu_orientation, *menu_remove_whitespaces,
-		*menu_language, *menu;
+	GMenu *menu_auto_clipboard, *menu_orientation, *menu_profile,
+		*menu_deadline, *menu_watch, *menu_regions, *menu_recapture,
+		*menu_remove_whitespaces, *menu_preprocess, *menu;
 	
 	mw = (main_window*)pdata;
 	mw->window = gtk_application_window_new(app);
@@ -351,10 +662,10 @@ void create_main_window(GtkApplication* app, gpointer pdata) {
 	gtk_widget_set_tooltip_text(mw->button,
 		"Select an area on screen to capture text from.");
 	gtk_widget_set_size_request(mw->button, 100, 35);
+	/* Recognizing needs the substitutions */
+	gtk_widget_set_sensitive(mw->button, mw->substitutions != NULL);
 	gtk_box_pack_start(GTK_BOX(mw->button_box), mw->button, FALSE, FALSE,
 		FALSE);
-	if (mw->tess_handle == NULL)
-		gtk_widget_set_sensitive(mw->button, FALSE);
 		
 	mw->history_box = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 0);
 	style_context = gtk_widget_get_style_context(mw->history_box);
@@ -411,6 +722,73 @@ void create_main_window(GtkApplication* app, gpointer pdata) {
 	g_menu_append_section(menu, NULL, G_MENU_MODEL(menu_orientation));
 	g_object_unref(menu_orientation);
 	mw->setting_orientation = TEXT_ORIENTATION_AUTO;
+	ocr_pool_preload(mw->ocr_pool, mw->setting_orientation);
+	
+	menu_profile = g_menu_new();
+	g_menu_append(menu_profile, "Fast recognition", "app.profile::fast");
+	g_menu_append(menu_profile, "Balanced recognition",
+		"app.profile::balanced");
+	g_menu_append(menu_profile, "Accurate recognition",
+		"app.profile::accurate");
+	g_menu_append(menu_profile, "Show a quick text first",
+		"app.progressive");
+	g_menu_append_section(menu, NULL, G_MENU_MODEL(menu_profile));
+	g_object_unref(menu_profile);
+	mw->setting_profile = OCR_PROFILE_BALANCED;
+	mw->setting_progressive = FALSE;
+	
+	menu_deadline = g_menu_new();
+	g_menu_append(menu_deadline, "Stop recognizing after 5 seconds",
+		"app.deadline(5000)");
+	g_menu_append(menu_deadline, "Stop recognizing after 20 seconds",
+		"app.deadline(20000)");
+	g_menu_append(menu_deadline, "Never stop recognizing",
+		"app.deadline(0)");
+	g_menu_append_section(menu, NULL, G_MENU_MODEL(menu_deadline));
+	g_object_unref(menu_deadline);
+	mw->setting_ocr_deadline = MAIN_WINDOW_OCR_DEADLINE;
+	ocr_pool_set_deadline(mw->ocr_pool, mw->setting_ocr_deadline);
+	
+	menu_watch = g_menu_new();
+	g_menu_append(menu_watch, "Recognize the area again when it changes",
+		"app.watch");
+	g_menu_append(menu_watch, "Check it 4 times a second",
+		"app.watch-interval(250)");
+	g_menu_append(menu_watch, "Check it once a second",
+		"app.watch-interval(1000)");
+	g_menu_append_section(menu, NULL, G_MENU_MODEL(menu_watch));
+	g_object_unref(menu_watch);
+	mw->setting_watch = FALSE;
+	mw->setting_watch_interval = MAIN_WINDOW_WATCH_INTERVAL;
+	mw->last_rect_valid = FALSE;
+	mw->watch = NULL;
+	
+	menu_regions = g_menu_new();
+	for (i = 1; i <= MAIN_WINDOW_REGIONS_IN_MENU; i++) {
+		asprintf(&label, "Capture area %d", i);
+		asprintf(&detail_string, "app.capture-region::%d", i);
+		g_menu_append(menu_regions, label, detail_string);
+		free(label);
+		free(detail_string);
+	}
+	for (i = 1; i <= MAIN_WINDOW_REGIONS_IN_MENU; i++) {
+		asprintf(&label, "Save the last area as area %d", i);
+		asprintf(&detail_string, "app.save-region::%d", i);
+		g_menu_append(menu_regions, label, detail_string);
+		free(label);
+		free(detail_string);
+	}
+	menu_recapture = g_menu_new();
+	g_menu_append(menu_recapture, "Freeze the screen while selecting",
+		"app.freeze");
+	g_menu_append(menu_recapture, "Capture the last area again",
+		"app.recapture");
+	g_menu_append_submenu(menu_recapture, "Saved areas",
+		G_MENU_MODEL(menu_regions));
+	g_menu_append_section(menu, NULL, G_MENU_MODEL(menu_recapture));
+	g_object_unref(menu_regions);
+	g_object_unref(menu_recapture);
+	mw->setting_freeze = FALSE;
 	
 	menu_remove_whitespaces = g_menu_new();
 	g_menu_append(menu_remove_whitespaces, "Remove whitespaces",
@@ -419,22 +797,38 @@ void create_main_window(GtkApplication* app, gpointer pdata) {
 	g_object_unref(menu_remove_whitespaces);
 	mw->setting_remove_whitespaces = TRUE;
 	
-	menu_language = g_menu_new();
-	pos = 0;
-	if (mw->dictionary) {
-		while ((lang = vector_get_const(mw->dictionary->languages, pos++))) {
-			asprintf(&detail_string, "app.language::%s%s", lang->table_name,
-				lang->column_name);
-			g_menu_append(menu_language, lang->display_name, detail_string);
-			free(detail_string);
-		}
-	}
-	g_menu_append_section(menu, NULL, G_MENU_MODEL(menu_language));
-	g_object_unref(menu_language);
+	menu_preprocess = g_menu_new();
+	g_menu_append(menu_preprocess, "Enhance image", "app.preprocess");
+	g_menu_append_section(menu, NULL, G_MENU_MODEL(menu_preprocess));
+	g_object_unref(menu_preprocess);
+	mw->setting_preprocess.enabled = TRUE;
+	mw->setting_preprocess.crop = TRUE;
+	mw->setting_preprocess.glyph_height =
+		ocr_pool_get_profile(mw->setting_profile)->glyph_height;
+	mw->setting_preprocess.binarize = BINARIZE_SAUVOLA;
+	
+	mw->ocr_shown_id = 0;
+	mw->ocr_shown_preliminary = FALSE;
+	mw->ocr_last_id = 0;
+	mw->progress_source_id = 0;
+	mw->setting_lookup_budget.max_work = MAIN_WINDOW_LOOKUP_MAX_WORK;
+	mw->setting_lookup_budget.max_time = MAIN_WINDOW_LOOKUP_MAX_TIME;
+	
+	/* The languages are added once the dictionary is loaded */
+	mw->menu_language = g_menu_new();
+	g_menu_append_section(menu, NULL, G_MENU_MODEL(mw->menu_language));
+	g_object_unref(mw->menu_language);
 	
 	gtk_menu_button_set_menu_model(GTK_MENU_BUTTON(mw->menu_button),
 		G_MENU_MODEL(menu));
 
+	mw->progress_bar = gtk_progress_bar_new();
+	gtk_widget_set_tooltip_text(mw->progress_bar,
+		"Recognizing text, press Escape to stop.");
+	gtk_widget_set_no_show_all(mw->progress_bar, TRUE);
+	gtk_box_pack_start(GTK_BOX(mw->main_box), mw->progress_bar, FALSE, FALSE,
+		FALSE);
+	
 	mw->text_paned = gtk_paned_new(GTK_ORIENTATION_VERTICAL);
 	gtk_box_pack_start(GTK_BOX(mw->main_box), mw->text_paned, TRUE, TRUE,
 		FALSE);
@@ -474,37 +868,84 @@ void create_main_window(GtkApplication* app, gpointer pdata) {
 	gtk_widget_show_all(mw->window);
 	memset(mw->history_entries, 0, sizeof(mw->history_entries));
 	mw->cur_history_entry = MAIN_WINDOW_HISTORY_ENTRIES_MAX-1;
+	if (mw->dictionary != NULL) {
+		mw_add_languages(mw);
+		language_set(mw, 0);
+	}
+}
+
+void mw_set_substitutions(main_window *mw, Substitutions *substitutions) {
+	mw->substitutions = substitutions;
+	if (mw->window != NULL)
+		gtk_widget_set_sensitive(mw->button, TRUE);
+}
+
+void mw_set_dictionary(main_window *mw, Dictionary *dictionary,
+	jpn_Rule_vector *deinflect_rules) {
+	mw->dictionary = dictionary;
+	mw->deinflect_rules = deinflect_rules;
+	if (mw->window == NULL)
+		return;
+	mw_add_languages(mw);
+	/* This also looks up the word at the cursor */
+	language_set(mw, 0);
 }
 
 void startup_main_window(GApplication* app, gpointer pdata) {
 	main_window *mw = (main_window*)pdata;
-	char *state;
+	const char *recapture_accels[] = {"<Primary>r", NULL};
+	const char *region_accels[] = {NULL, NULL};
+	char *accel, *detail_string;
+	int i;
 	
 	GActionEntry entries[] = {
 		{"auto-clipboard", auto_clipboard_callback, NULL, "false",
 			auto_clipboard_set_state},
 		{"orientation", orientation_callback, "s", "'auto'",
 			orientation_set_state},
+		{"profile", profile_callback, "s", "'balanced'",
+			profile_set_state},
+		{"progressive", progressive_callback, NULL, "false",
+			progressive_set_state},
+		{"deadline", deadline_callback, "i", "20000", deadline_set_state},
+		{"watch", watch_callback, NULL, "false", watch_set_state},
+		{"watch-interval", watch_interval_callback, "i", "250",
+			watch_interval_set_state},
+		{"recapture", recapture_callback},
+		{"capture-region", capture_region_callback, "s"},
+		{"save-region", save_region_callback, "s"},
 		{"remove-whitespaces", remove_whitespaces_callback, NULL, "true",
 			remove_whitespaces_set_state},
-		{"language", language_callback, "s", NULL,
-			language_set_state}
+		{"language", language_callback, "s", "''",
+			language_set_state},
+		{"preprocess", preprocess_callback, NULL, "true",
+			preprocess_set_state},
+		{"freeze", freeze_callback, NULL, "false", freeze_set_state}
 	};
-	if (mw->dictionary) {
-		mw->setting_language = *(const dictionary_Language*)vector_get_const(
-			mw->dictionary->languages, 0);
-		asprintf(&state, "'%s%s'", mw->setting_language.table_name,
-			mw->setting_language.column_name);
-		entries[3].state = state;
-	}
-	
 	g_action_map_add_action_entries(G_ACTION_MAP(app), entries,
 		G_N_ELEMENTS(entries), mw);
+	/* The actions can also be activated from outside, e.g. by a hotkey
+		daemon through "gapplication action" */
+	gtk_application_set_accels_for_action(GTK_APPLICATION(app),
+		"app.recapture", recapture_accels);
+	for (i = 1; i <= MAIN_WINDOW_REGIONS_IN_MENU; i++) {
+		asprintf(&accel, "<Primary>%d", i);
+		asprintf(&detail_string, "app.capture-region::%d", i);
+		region_accels[0] = accel;
+		gtk_application_set_accels_for_action(GTK_APPLICATION(app),
+			detail_string, region_accels);
+		free(accel);
+		free(detail_string);
+	}
+	mw->regions = g_key_file_new();
+	mw->regions_file = g_build_filename(g_get_user_config_dir(), "jpncap",
+		"regions.ini", NULL);
+	/* There are no saved areas until the file is written */
+	g_key_file_load_from_file(mw->regions, mw->regions_file,
+		G_KEY_FILE_KEEP_COMMENTS, NULL);
 	mw->clipboard = gtk_clipboard_get(GDK_SELECTION_CLIPBOARD);
 	mw->clipboard_hanlder_id = g_signal_connect(mw->clipboard, "owner-change",
 		G_CALLBACK(auto_clipboard_owner_change), mw);
-	if (mw->dictionary)
-		free(state);
 }
 
 void shutdown_main_window(GApplication *app, gpointer pdata) {
@@ -515,6 +956,16 @@ void shutdown_main_window(GApplication *app, gpointer pdata) {
 		if (mw->history_entries[i] != NULL)
 			free(mw->history_entries[i]);
 	}
+	if (mw->progress_source_id != 0) {
+		g_source_remove(mw->progress_source_id);
+		mw->progress_source_id = 0;
+	}
+	if (mw->watch != NULL) {
+		capture_watch_stop(mw->watch);
+		mw->watch = NULL;
+	}
+	g_key_file_free(mw->regions);
+	g_free(mw->regions_file);
 	/* Disconnect the owner-change event */
 	g_signal_handler_disconnect(mw->clipboard, mw->clipboard_hanlder_id);
 }
@@ -587,13 +1038,17 @@ void mw_history_move(main_window* mw, int n) {
 	mw_update(mw);
 }
 
-static void mw_history_add(main_window* mw, const char* text) {
+/** Adds text to the history unless it is empty or the same as the last
+	entry. Returns whether it was added. A preliminary text is not the last
+	entry anymore then, the caller sets it again if text is one.
+*/
+static int mw_history_add(main_window* mw, const char* text) {
 	int i;
 	
 	if (mw->history_entries[MAIN_WINDOW_HISTORY_ENTRIES_MAX-1] != NULL &&
 		(strcmp(text, mw->history_entries[MAIN_WINDOW_HISTORY_ENTRIES_MAX-1])
 		== 0 || strlen(text) == 0))
-		return;
+		return 0;
 	
 	if (mw->history_entries[0] != NULL)
 		free(mw->history_entries[0]);
@@ -604,9 +1059,38 @@ static void mw_history_add(main_window* mw, const char* text) {
 	mw->history_entries[MAIN_WINDOW_HISTORY_ENTRIES_MAX-1] =
 		malloc(strlen(text) + 1);
 	strcpy(mw->history_entries[MAIN_WINDOW_HISTORY_ENTRIES_MAX-1], text);
+	mw->ocr_shown_preliminary = FALSE;
+	return 1;
+}
+
+/** Replaces the last history entry with text. If it is shown, the cursor
+	stays where it is as far as the text allows.
+*/
+static void mw_history_replace_last(main_window *mw, const char *text) {
+	char **entry = mw->history_entries + MAIN_WINDOW_HISTORY_ENTRIES_MAX - 1;
+	GtkTextBuffer *buffer;
+	GtkTextIter iter;
+	int offset;
+	
+	free(*entry);
+	*entry = malloc(strlen(text) + 1);
+	strcpy(*entry, text);
+	if (mw->cur_history_entry != MAIN_WINDOW_HISTORY_ENTRIES_MAX - 1)
+		return;
+	
+	buffer = gtk_text_view_get_buffer(GTK_TEXT_VIEW(mw->raw_text_view));
+	gtk_text_buffer_get_iter_at_mark(buffer, &iter,
+		gtk_text_buffer_get_insert(buffer));
+	offset = gtk_text_iter_get_offset(&iter);
+	gtk_text_buffer_set_text(buffer, text, strlen(text));
+	/* Offsets past the end give the end */
+	gtk_text_buffer_get_iter_at_offset(buffer, &iter, offset);
+	gtk_text_buffer_place_cursor(buffer, &iter);
 }
 
 void updateTextViews(main_window* mw, const char* text) {
+	/* The final text of a recognition must not replace this one */
+	mw->ocr_shown_preliminary = FALSE;
 	mw_history_add(mw, text);
 	mw_history_move(mw, MAIN_WINDOW_HISTORY_ENTRIES_MAX);
 }
@@ -24,8 +24,22 @@
 #include "vector.h"
 #include "dictionary.h"
 #include "recognize.h"
+#include "ocr_pool.h"
+#include "capture.h"
 
 #define MAIN_WINDOW_HISTORY_ENTRIES_MAX 50
+/* Limits for looking up a word, the time is in microseconds */
+#define MAIN_WINDOW_LOOKUP_MAX_WORK 200000
+#define MAIN_WINDOW_LOOKUP_MAX_TIME 50000
+/* Milliseconds a recognition may take by default and between updates of
+	its progress */
+#define MAIN_WINDOW_OCR_DEADLINE 20000
+#define MAIN_WINDOW_PROGRESS_INTERVAL 100
+/* Milliseconds between reads of a watched area by default */
+#define MAIN_WINDOW_WATCH_INTERVAL 250
+/* Saved areas offered in the menu, more can be saved by name through the
+	actions */
+#define MAIN_WINDOW_REGIONS_IN_MENU 4
 
 typedef struct {
 	GtkApplication *app;
@@ -37,11 +51,13 @@ typedef struct {
 	GtkWidget *back_button;
 	GtkWidget *forward_button;
 	GtkWidget *menu_button;
+	GtkWidget *progress_bar;
 	GtkWidget *text_paned;
 	GtkWidget *raw_text_view;
 	GtkWidget *raw_scrolled_window;
 	GtkWidget *dict_text_view;
 	GtkWidget *dict_scrolled_window;
+	GMenu *menu_language;
 	
 	char *history_entries[MAIN_WINDOW_HISTORY_ENTRIES_MAX];
 	int cur_history_entry;
@@ -49,17 +65,51 @@ typedef struct {
 	gulong clipboard_hanlder_id;
 	gboolean setting_auto_clipboard;
 	text_ori setting_orientation;
+	ocr_profile setting_profile;
+	gboolean setting_progressive;
+	/* Milliseconds a recognition may take or 0 */
+	int setting_ocr_deadline;
 	gboolean setting_remove_whitespaces;
+	gboolean setting_freeze;
+	gboolean setting_watch;
+	int setting_watch_interval;
+	recognize_Preprocess setting_preprocess;
 	dictionary_Language setting_language;
+	jpn_Budget setting_lookup_budget;
 	
-	TessBaseAPI *tess_handle;
-	Vector *substitutions;
-	Vector *deinflect_rules;
-	Dictionary *dictionary;
+	Ocr_pool *ocr_pool;
+	/* The id of the recognition shown last and of the one queued last */
+	guint ocr_shown_id;
+	guint ocr_last_id;
+	/* Whether the last history entry is the preliminary text of the
+		recognition shown last */
+	gboolean ocr_shown_preliminary;
+	/* The timeout updating the progress bar or 0 */
+	guint progress_source_id;
+	/* The area captured last and its watch, which is NULL unless
+		setting_watch is set and an area was captured */
+	GdkRectangle last_rect;
+	gboolean last_rect_valid;
+	capture_Watch *watch;
+	/* Saved areas, a group per name with the keys x, y, width and height */
+	GKeyFile *regions;
+	char *regions_file;
+	/* Loaded while the window is shown, NULL until then */
+	Substitutions *substitutions;
+	jpn_Rule_vector *deinflect_rules;
+	Dictionary *dictionary;
 } main_window;
 
 void create_main_window(GtkApplication* app, gpointer data);
 void startup_main_window(GApplication* app, gpointer pdata);
 void shutdown_main_window(GApplication *app, gpointer pdata);
+/** Hands the loaded substitutions to the window, which enables capturing.
+*/
+void mw_set_substitutions(main_window *mw, Substitutions *substitutions);
+/** Hands the loaded dictionary and deinflection rules to the window, which
+	enables looking up words.
+*/
+void mw_set_dictionary(main_window *mw, Dictionary *dictionary,
+	jpn_Rule_vector *deinflect_rules);
 void mw_history_move(main_window* mw, int n);
 void updateTextViews(main_window* mw, const char* text);
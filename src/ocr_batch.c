@@ -0,0 +1,396 @@
+/*
+ * Copyright 2017 sprin0
+ * 
+ * This file is part of JpnCap.
+ * 
+ * JpnCap is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * JpnCap is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with JpnCap.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* jpncap-ocr recognizes the text in image files without the window, e.g. to
+	process a folder of screenshots or to measure the throughput of the
+	recognition. Every file gives a line of JSON on stdout. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <locale.h>
+#include <glib.h>
+#include <gdk/gdk.h>
+
+#include "recognize.h"
+#include "ocr_pool.h"
+#include "vector.h"
+
+#include "configuration.h"
+
+typedef struct {
+	char *file_name;
+	/* Set on success, otherwise error is */
+	char *text;
+	const char *error;
+	text_ori orientation;
+	int confidence;
+	int width;
+	int height;
+	/* Microseconds */
+	gint64 load;
+	recognize_Timing timing;
+	gint64 total;
+	int done;
+} Result;
+
+VECTOR_DEFINE(Result_vector, result_vector, Result)
+
+typedef struct {
+	Result_vector *results;
+	/* The first result not written yet, guarded by lock */
+	size_t next;
+	size_t failed;
+	GMutex lock;
+	/* Idle Tesseract handles for every orientation. A worker only takes one
+		at a time, so there are at most as many as workers. */
+	GAsyncQueue *handles[3];
+	ocr_profile profile;
+	recognize_Preprocess preprocess;
+	text_ori orientation;
+	int remove_whitespaces;
+	Substitutions *substitutions;
+} Batch;
+
+static const char *const orientation_names[] = {
+	[TEXT_ORIENTATION_AUTO] = "auto",
+	[TEXT_ORIENTATION_VERTICAL] = "vertical",
+	[TEXT_ORIENTATION_HORIZONTAL] = "horizontal"
+};
+
+/** Writes s as a JSON string to file.
+*/
+static void json_write_string(FILE *file, const char *s) {
+	putc('"', file);
+	for (; *s; s++) {
+		switch (*s) {
+		case '"':
+			fputs("\\\"", file);
+			break;
+		case '\\':
+			fputs("\\\\", file);
+			break;
+		case '\n':
+			fputs("\\n", file);
+			break;
+		case '\t':
+			fputs("\\t", file);
+			break;
+		default:
+			if ((unsigned char)*s < 0x20)
+				fprintf(file, "\\u%04x", *s);
+			else
+				putc(*s, file);
+		}
+	}
+	putc('"', file);
+}
+
+static void result_write(const Result *result, FILE *file) {
+	const recognize_Timing *t = &result->timing;
+	char *name;
+	
+	name = g_filename_display_name(result->file_name);
+	fputs("{\"file\":", file);
+	json_write_string(file, name);
+	g_free(name);
+	if (result->text != NULL) {
+		fprintf(file, ",\"width\":%d,\"height\":%d,\"orientation\":\"%s\","
+			"\"confidence\":%d,\"text\":", result->width, result->height,
+			orientation_names[result->orientation], result->confidence);
+		json_write_string(file, result->text);
+	} else {
+		fputs(",\"error\":", file);
+		json_write_string(file, result->error);
+	}
+	fprintf(file, ",\"ms\":{\"load\":%.1f,\"convert\":%.1f,\"analyze\":%.1f,"
+		"\"crop\":%.1f,\"scale\":%.1f,\"binarize\":%.1f,\"recognize\":%.1f,"
+		"\"postprocess\":%.1f,\"total\":%.1f}}\n", result->load / 1000.0,
+		t->convert / 1000.0, t->analyze / 1000.0, t->crop / 1000.0,
+		t->scale / 1000.0, t->binarize / 1000.0, t->recognize / 1000.0,
+		t->postprocess / 1000.0, result->total / 1000.0);
+}
+
+static void timing_add(recognize_Timing *sum, const recognize_Timing *t) {
+	sum->convert += t->convert;
+	sum->analyze += t->analyze;
+	sum->crop += t->crop;
+	sum->scale += t->scale;
+	sum->binarize += t->binarize;
+	sum->recognize += t->recognize;
+	sum->postprocess += t->postprocess;
+}
+
+/** Recognizes pixbuf in orientation with a handle of batch and adds the time
+	it took to result. Returns NULL and sets the error of result on failure.
+*/
+static char *batch_recognize(Batch *batch, GdkPixbuf *pixbuf,
+	text_ori orientation, Result *result, int *confidence) {
+	GAsyncQueue *handles = batch->handles[orientation];
+	recognize_Timing timing;
+	TessBaseAPI *handle;
+	char *text;
+	
+	if ((handle = g_async_queue_try_pop(handles)) == NULL
+		&& (handle = ocr_pool_handle_create(batch->profile, orientation))
+		== NULL) {
+		result->error = "Could not initialize Tesseract";
+		return NULL;
+	}
+	text = processPixbuf(pixbuf, NULL, &batch->preprocess, orientation,
+		batch->remove_whitespaces, handle, batch->substitutions, NULL,
+		&timing, confidence);
+	g_async_queue_push(handles, handle);
+	timing_add(&result->timing, &timing);
+	if (text == NULL)
+		result->error = "Could not recognize the text";
+	return text;
+}
+
+static void batch_run_file(Batch *batch, Result *result) {
+	GdkPixbuf *pixbuf;
+	GError *error = NULL;
+	char *texts[2];
+	int confidences[2];
+	gint64 start;
+	
+	start = g_get_monotonic_time();
+	pixbuf = gdk_pixbuf_new_from_file(result->file_name, &error);
+	result->load = g_get_monotonic_time() - start;
+	if (pixbuf == NULL) {
+		result->error = "Could not load the image";
+		g_error_free(error);
+		return;
+	}
+	result->width = gdk_pixbuf_get_width(pixbuf);
+	result->height = gdk_pixbuf_get_height(pixbuf);
+	
+	/* Like in the window, both orientations are tried and the result
+		Tesseract is more confident in is kept unless the layout tells */
+	result->orientation = batch->orientation;
+	if (result->orientation == TEXT_ORIENTATION_AUTO)
+		result->orientation = recognize_guess_orientation(pixbuf, NULL);
+	if (result->orientation != TEXT_ORIENTATION_AUTO)
+		result->text = batch_recognize(batch, pixbuf, result->orientation,
+			result, &result->confidence);
+	else {
+		texts[0] = batch_recognize(batch, pixbuf, TEXT_ORIENTATION_VERTICAL,
+			result, confidences);
+		texts[1] = batch_recognize(batch, pixbuf,
+			TEXT_ORIENTATION_HORIZONTAL, result, confidences + 1);
+		if (texts[1] != NULL
+			&& (texts[0] == NULL || confidences[1] > confidences[0])) {
+			free(texts[0]);
+			result->text = texts[1];
+			result->confidence = confidences[1];
+			result->orientation = TEXT_ORIENTATION_HORIZONTAL;
+		} else {
+			free(texts[1]);
+			result->text = texts[0];
+			result->confidence = confidences[0];
+			result->orientation = TEXT_ORIENTATION_VERTICAL;
+		}
+	}
+	g_object_unref(pixbuf);
+}
+
+/** Recognizes the file of a result on a worker thread. The results are
+	written in the order of the files as soon as all before them are done.
+*/
+static void batch_run(gpointer data, gpointer pdata) {
+	Result *result = (Result*)data;
+	Batch *batch = (Batch*)pdata;
+	gint64 start = g_get_monotonic_time();
+	
+	batch_run_file(batch, result);
+	result->total = g_get_monotonic_time() - start;
+	
+	g_mutex_lock(&batch->lock);
+	result->done = 1;
+	for (; batch->next < batch->results->length
+		&& batch->results->data[batch->next].done; batch->next++) {
+		result = batch->results->data + batch->next;
+		result_write(result, stdout);
+		batch->failed += result->text == NULL;
+		free(result->text);
+		result->text = NULL;
+	}
+	fflush(stdout);
+	g_mutex_unlock(&batch->lock);
+}
+
+static void result_add(Result_vector *results, const char *file_name) {
+	Result result;
+	
+	memset(&result, 0, sizeof(result));
+	result.file_name = g_strdup(file_name);
+	result_vector_append(results, result);
+}
+
+static int compare_strings(const void *pa, const void *pb) {
+	return strcmp(*(char *const *)pa, *(char *const *)pb);
+}
+
+/** Adds the images in the directory path to results in the order of their
+	names. Returns 0 if path cannot be read.
+*/
+static int results_add_directory(Result_vector *results, const char *path) {
+	GDir *dir;
+	GPtrArray *names;
+	const char *name;
+	char *file_name;
+	guint i;
+	
+	if ((dir = g_dir_open(path, 0, NULL)) == NULL)
+		return 0;
+	names = g_ptr_array_new_with_free_func(g_free);
+	while ((name = g_dir_read_name(dir)) != NULL) {
+		file_name = g_build_filename(path, name, NULL);
+		/* Only the header of a file is read to tell whether it is an
+			image */
+		if (g_file_test(file_name, G_FILE_TEST_IS_REGULAR)
+			&& gdk_pixbuf_get_file_info(file_name, NULL, NULL) != NULL)
+			g_ptr_array_add(names, file_name);
+		else
+			g_free(file_name);
+	}
+	g_dir_close(dir);
+	qsort(names->pdata, names->len, sizeof(char*), compare_strings);
+	for (i = 0; i < names->len; i++)
+		result_add(results, g_ptr_array_index(names, i));
+	g_ptr_array_free(names, TRUE);
+	return 1;
+}
+
+int main(int argc, char **argv) {
+	char *orientation = NULL, *profile = NULL;
+	char *substitutions_file = JPNCAP_RESOURCES_PATH "/substitutions.txt";
+	gboolean no_preprocess = FALSE, keep_whitespaces = FALSE;
+	int threads = g_get_num_processors();
+	GOptionEntry options[] = {
+		{"threads", 'j', 0, G_OPTION_ARG_INT, &threads,
+			"Number of worker threads", "N"},
+		{"orientation", 'o', 0, G_OPTION_ARG_STRING, &orientation,
+			"Text orientation: auto, vertical or horizontal", "ORIENTATION"},
+		{"profile", 'p', 0, G_OPTION_ARG_STRING, &profile,
+			"Recognition profile: fast, balanced or accurate", "PROFILE"},
+		{"no-preprocess", 0, 0, G_OPTION_ARG_NONE, &no_preprocess,
+			"Do not enhance the images", NULL},
+		{"keep-whitespaces", 0, 0, G_OPTION_ARG_NONE, &keep_whitespaces,
+			"Do not remove whitespaces", NULL},
+		{"substitutions", 's', 0, G_OPTION_ARG_FILENAME, &substitutions_file,
+			"Substitutions to apply to the texts", "FILE"},
+		{NULL}
+	};
+	GOptionContext *context;
+	GError *error = NULL;
+	GThreadPool *pool;
+	TessBaseAPI *handle;
+	Batch batch;
+	gint64 start;
+	size_t i;
+	int status = 0;
+	
+	context = g_option_context_new("FILE|DIRECTORY...");
+	g_option_context_set_summary(context, "Recognizes the Japanese text in "
+		"images and writes it as JSON lines with the time every stage took.");
+	g_option_context_add_main_entries(context, options, NULL);
+	if (!g_option_context_parse(context, &argc, &argv, &error)) {
+		fprintf(stderr, "%s\n", error->message);
+		g_error_free(error);
+		g_option_context_free(context);
+		return 1;
+	}
+	g_option_context_free(context);
+	
+	memset(&batch, 0, sizeof(batch));
+	batch.orientation = TEXT_ORIENTATION_AUTO;
+	if (orientation != NULL) {
+		for (i = 0; i < 3 && strcmp(orientation, orientation_names[i]) != 0;
+			i++);
+		if (i == 3) {
+			fprintf(stderr, "Unknown orientation %s\n", orientation);
+			return 1;
+		}
+		batch.orientation = i;
+	}
+	batch.profile = OCR_PROFILE_BALANCED;
+	if (profile != NULL) {
+		for (i = 0; i < OCR_PROFILES_LENGTH && strcmp(profile,
+			ocr_pool_get_profile(i)->name) != 0; i++);
+		if (i == OCR_PROFILES_LENGTH) {
+			fprintf(stderr, "Unknown profile %s\n", profile);
+			return 1;
+		}
+		batch.profile = i;
+	}
+	batch.preprocess.enabled = !no_preprocess;
+	batch.preprocess.crop = TRUE;
+	batch.preprocess.glyph_height =
+		ocr_pool_get_profile(batch.profile)->glyph_height;
+	batch.preprocess.binarize = BINARIZE_SAUVOLA;
+	batch.remove_whitespaces = !keep_whitespaces;
+	
+	batch.results = result_vector_create();
+	for (i = 1; i < argc; i++) {
+		if (!g_file_test(argv[i], G_FILE_TEST_IS_DIR))
+			result_add(batch.results, argv[i]);
+		else if (!results_add_directory(batch.results, argv[i]))
+			fprintf(stderr, "Could not read the directory %s\n", argv[i]);
+	}
+	if (batch.results->length == 0) {
+		fprintf(stderr, "No images given, see --help\n");
+		result_vector_destroy(batch.results);
+		return 1;
+	}
+	
+	/* Tesseract needs this setlocale call on non English platforms */
+	setlocale(LC_NUMERIC, "C");
+	batch.substitutions = substitutions_load(substitutions_file);
+	g_mutex_init(&batch.lock);
+	for (i = 0; i < 3; i++)
+		batch.handles[i] = g_async_queue_new();
+	
+	start = g_get_monotonic_time();
+	pool = g_thread_pool_new(batch_run, &batch, MAX(1, threads), FALSE, NULL);
+	for (i = 0; i < batch.results->length; i++)
+		g_thread_pool_push(pool, batch.results->data + i, NULL);
+	g_thread_pool_free(pool, FALSE, TRUE);
+	fprintf(stderr, "%lu images, %lu failed, %.2f s, %.2f images/s\n",
+		batch.results->length, batch.failed,
+		(g_get_monotonic_time() - start) / 1000000.0,
+		batch.results->length * 1000000.0
+		/ MAX(1, g_get_monotonic_time() - start));
+	if (batch.failed > 0)
+		status = 1;
+	
+	for (i = 0; i < 3; i++) {
+		while ((handle = g_async_queue_try_pop(batch.handles[i])) != NULL)
+			ocr_pool_handle_destroy(handle);
+		g_async_queue_unref(batch.handles[i]);
+	}
+	for (i = 0; i < batch.results->length; i++)
+		g_free(batch.results->data[i].file_name);
+	result_vector_destroy(batch.results);
+	g_mutex_clear(&batch.lock);
+	substitutions_destroy(batch.substitutions);
+	g_free(orientation);
+	g_free(profile);
+	return status;
+}
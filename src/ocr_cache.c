@@ -0,0 +1,296 @@
+/*
+ * Copyright 2017 sprin0
+ * 
+ * This file is part of JpnCap.
+ * 
+ * JpnCap is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * JpnCap is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with JpnCap.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <glib/gstdio.h>
+
+#include "ocr_cache.h"
+#include "hashmap.h"
+
+#define FILE_MAGIC "JPNCAP OCR CACHE 2\n"
+/* Longer texts in a cache file are taken as a sign of a broken file */
+#define FILE_TEXT_LENGTH_MAX (1 << 20)
+
+typedef struct {
+	recognize_Fingerprint fingerprint;
+	uint64_t settings;
+	/* NULL if the entry is not used */
+	char *text;
+	gint64 duration;
+	uint64_t last_used;
+} Entry;
+
+HASHMAP_DEFINE(Slot_map, slot_map, uint64_t, size_t, hashmap_hash_int,
+	HASHMAP_EQUALS_INT)
+
+struct Ocr_cache {
+	Entry *entries;
+	size_t size;
+	size_t length;
+	/* Maps the keys of the entries to their positions */
+	Slot_map *slots;
+	uint64_t clock;
+	/* Whether texts were added since the cache was loaded or saved */
+	int modified;
+	ocr_cache_Stats stats;
+	GMutex lock;
+};
+
+static uint64_t entry_key(const recognize_Fingerprint *fingerprint,
+	uint64_t settings) {
+	return fingerprint->exact ^ hashmap_hash_int(settings);
+}
+
+/** Returns the entry of the capture with fingerprint and settings or NULL if
+	there is none.
+*/
+static Entry *cache_find(Ocr_cache *cache,
+	const recognize_Fingerprint *fingerprint, uint64_t settings) {
+	Entry *entry;
+	size_t *slot;
+	
+	slot = slot_map_get(cache->slots, entry_key(fingerprint, settings));
+	if (slot == NULL)
+		return NULL;
+	entry = cache->entries + *slot;
+	if (entry->settings != settings
+		|| entry->fingerprint.exact != fingerprint->exact
+		|| entry->fingerprint.width != fingerprint->width
+		|| entry->fingerprint.height != fingerprint->height)
+		return NULL;
+	return entry;
+}
+
+Ocr_cache *ocr_cache_create(size_t size) {
+	Ocr_cache *cache;
+	
+	cache = malloc(sizeof(*cache));
+	cache->size = MAX(1, size);
+	cache->entries = calloc(cache->size, sizeof(Entry));
+	cache->length = 0;
+	cache->slots = slot_map_create();
+	cache->clock = 0;
+	cache->modified = 0;
+	memset(&cache->stats, 0, sizeof(cache->stats));
+	g_mutex_init(&cache->lock);
+	return cache;
+}
+
+void ocr_cache_destroy(Ocr_cache *cache) {
+	size_t i;
+	
+	for (i = 0; i < cache->length; i++)
+		free(cache->entries[i].text);
+	free(cache->entries);
+	slot_map_destroy(cache->slots);
+	g_mutex_clear(&cache->lock);
+	free(cache);
+}
+
+char *ocr_cache_lookup(Ocr_cache *cache,
+	const recognize_Fingerprint *fingerprint, uint64_t settings) {
+	Entry *entry;
+	char *text = NULL;
+	
+	if (fingerprint->width == 0)
+		return NULL;
+	
+	g_mutex_lock(&cache->lock);
+	if ((entry = cache_find(cache, fingerprint, settings)) != NULL) {
+		entry->last_used = ++cache->clock;
+		text = strdup(entry->text);
+		cache->stats.hits++;
+		cache->stats.time_saved += entry->duration;
+	} else
+		cache->stats.misses++;
+	g_mutex_unlock(&cache->lock);
+	return text;
+}
+
+/** Adds text like ocr_cache_add. loaded tells whether it comes from a file,
+	which does not make the cache differ from it.
+*/
+static void cache_add(Ocr_cache *cache,
+	const recognize_Fingerprint *fingerprint, uint64_t settings,
+	const char *text, gint64 duration, int loaded) {
+	Entry *entry;
+	size_t slot, i, *old_slot;
+	uint64_t key;
+	
+	if (fingerprint->width == 0)
+		return;
+	
+	g_mutex_lock(&cache->lock);
+	key = entry_key(fingerprint, settings);
+	if ((old_slot = slot_map_get(cache->slots, key)) != NULL) {
+		/* The same capture was recognized twice at once */
+		slot = *old_slot;
+		free(cache->entries[slot].text);
+	} else if (cache->length < cache->size)
+		slot = cache->length++;
+	else {
+		/* Drop the least recently used entry */
+		slot = 0;
+		for (i = 1; i < cache->length; i++)
+			if (cache->entries[i].last_used < cache->entries[slot].last_used)
+				slot = i;
+		entry = cache->entries + slot;
+		old_slot = slot_map_get(cache->slots,
+			entry_key(&entry->fingerprint, entry->settings));
+		if (old_slot != NULL && *old_slot == slot)
+			slot_map_remove(cache->slots,
+				entry_key(&entry->fingerprint, entry->settings));
+		free(entry->text);
+	}
+	
+	entry = cache->entries + slot;
+	entry->fingerprint = *fingerprint;
+	entry->settings = settings;
+	entry->text = strdup(text);
+	entry->duration = duration;
+	entry->last_used = ++cache->clock;
+	slot_map_set(cache->slots, key, slot);
+	cache->modified |= !loaded;
+	g_mutex_unlock(&cache->lock);
+}
+
+void ocr_cache_add(Ocr_cache *cache, const recognize_Fingerprint *fingerprint,
+	uint64_t settings, const char *text, gint64 duration) {
+	cache_add(cache, fingerprint, settings, text, duration, 0);
+}
+
+void ocr_cache_get_stats(Ocr_cache *cache, ocr_cache_Stats *stats) {
+	g_mutex_lock(&cache->lock);
+	*stats = cache->stats;
+	g_mutex_unlock(&cache->lock);
+}
+
+/* The files hold the entries from the least to the most recently used, so
+	that loading them restores the order. Numbers are stored in the byte
+	order of the machine. */
+
+static int entry_read(FILE *file, Entry *entry) {
+	uint32_t length;
+	
+	if (fread(&entry->fingerprint.exact, sizeof(uint64_t), 1, file) != 1
+		|| fread(&entry->fingerprint.width, sizeof(int), 1, file) != 1
+		|| fread(&entry->fingerprint.height, sizeof(int), 1, file) != 1
+		|| fread(&entry->settings, sizeof(uint64_t), 1, file) != 1
+		|| fread(&entry->duration, sizeof(gint64), 1, file) != 1
+		|| fread(&length, sizeof(uint32_t), 1, file) != 1
+		|| length > FILE_TEXT_LENGTH_MAX)
+		return 1;
+	entry->text = malloc(length + 1);
+	if (fread(entry->text, 1, length, file) != length) {
+		free(entry->text);
+		return 1;
+	}
+	entry->text[length] = '\0';
+	return 0;
+}
+
+static int entry_write(FILE *file, const Entry *entry) {
+	uint32_t length = strlen(entry->text);
+	
+	return fwrite(&entry->fingerprint.exact, sizeof(uint64_t), 1, file) != 1
+		|| fwrite(&entry->fingerprint.width, sizeof(int), 1, file) != 1
+		|| fwrite(&entry->fingerprint.height, sizeof(int), 1, file) != 1
+		|| fwrite(&entry->settings, sizeof(uint64_t), 1, file) != 1
+		|| fwrite(&entry->duration, sizeof(gint64), 1, file) != 1
+		|| fwrite(&length, sizeof(uint32_t), 1, file) != 1
+		|| fwrite(entry->text, 1, length, file) != length;
+}
+
+int ocr_cache_load(Ocr_cache *cache, const char *file_name) {
+	FILE *file;
+	char magic[sizeof(FILE_MAGIC) - 1];
+	Entry entry;
+	
+	if ((file = fopen(file_name, "rb")) == NULL)
+		return 1;
+	if (fread(magic, 1, sizeof(magic), file) != sizeof(magic)
+		|| memcmp(magic, FILE_MAGIC, sizeof(magic)) != 0) {
+		fprintf(stderr, "%s is no OCR cache file\n", file_name);
+		fclose(file);
+		return 1;
+	}
+	while (entry_read(file, &entry) == 0) {
+		cache_add(cache, &entry.fingerprint, entry.settings, entry.text,
+			entry.duration, 1);
+		free(entry.text);
+	}
+	fclose(file);
+	return 0;
+}
+
+static int compare_last_used(const void *pa, const void *pb) {
+	const Entry *a = *(const Entry *const*)pa, *b = *(const Entry *const*)pb;
+	
+	return a->last_used < b->last_used ? -1 : a->last_used > b->last_used;
+}
+
+int ocr_cache_save(Ocr_cache *cache, const char *file_name) {
+	FILE *file;
+	char *temp_name;
+	const Entry **order;
+	size_t i;
+	int error;
+	
+	g_mutex_lock(&cache->lock);
+	error = !cache->modified;
+	g_mutex_unlock(&cache->lock);
+	/* The file already holds every text */
+	if (error)
+		return 0;
+	
+	temp_name = g_strconcat(file_name, ".tmp", NULL);
+	if ((file = fopen(temp_name, "wb")) == NULL) {
+		perror(temp_name);
+		g_free(temp_name);
+		return 1;
+	}
+	
+	g_mutex_lock(&cache->lock);
+	order = malloc(cache->length * sizeof(Entry*));
+	for (i = 0; i < cache->length; i++)
+		order[i] = cache->entries + i;
+	qsort(order, cache->length, sizeof(Entry*), compare_last_used);
+	error = fwrite(FILE_MAGIC, 1, sizeof(FILE_MAGIC) - 1, file)
+		!= sizeof(FILE_MAGIC) - 1;
+	for (i = 0; i < cache->length && !error; i++)
+		error = entry_write(file, order[i]);
+	g_mutex_unlock(&cache->lock);
+	free(order);
+	
+	error |= fclose(file) != 0;
+	/* Replacing the file at once keeps the old one if writing failed */
+	if (error || g_rename(temp_name, file_name) != 0) {
+		fprintf(stderr, "Could not save the OCR cache to %s\n", file_name);
+		g_remove(temp_name);
+		error = 1;
+	} else {
+		g_mutex_lock(&cache->lock);
+		cache->modified = 0;
+		g_mutex_unlock(&cache->lock);
+	}
+	g_free(temp_name);
+	return error;
+}
@@ -0,0 +1,68 @@
+/*
+ * Copyright 2017 sprin0
+ * 
+ * This file is part of JpnCap.
+ * 
+ * JpnCap is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * JpnCap is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with JpnCap.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <glib.h>
+
+#include "recognize.h"
+
+/* The most texts kept */
+#define OCR_CACHE_SIZE 256
+
+/** Remembers the recognized texts of captures, so that recognizing the same
+	dialogue box or subtitle again takes no time. Captures are looked up by an
+	exact hash of their pixels and their size, so a capture in which only a
+	few glyphs changed is recognized again. All functions may be called from
+	any thread.
+*/
+typedef struct Ocr_cache Ocr_cache;
+
+typedef struct {
+	unsigned long hits;
+	unsigned long misses;
+	/* Microseconds the cached texts took to recognize in the first place */
+	gint64 time_saved;
+} ocr_cache_Stats;
+
+/** Creates a cache of up to size texts. The least recently used text is
+	dropped for a new one.
+*/
+Ocr_cache *ocr_cache_create(size_t size);
+void ocr_cache_destroy(Ocr_cache *cache);
+/** Returns a copy of the text of the capture with fingerprint recognized with
+	settings, which is a hash of all settings that change the text, or NULL
+	if it is not in cache.
+*/
+char *ocr_cache_lookup(Ocr_cache *cache,
+	const recognize_Fingerprint *fingerprint, uint64_t settings);
+/** Adds a copy of text for the capture with fingerprint recognized with
+	settings. duration is the time it took in microseconds.
+*/
+void ocr_cache_add(Ocr_cache *cache, const recognize_Fingerprint *fingerprint,
+	uint64_t settings, const char *text, gint64 duration);
+void ocr_cache_get_stats(Ocr_cache *cache, ocr_cache_Stats *stats);
+/** Adds the texts saved in file_name to cache. Returns 0 on success.
+*/
+int ocr_cache_load(Ocr_cache *cache, const char *file_name);
+/** Saves the texts of cache to file_name unless no text was added since they
+	were loaded or saved. Returns 0 on success.
+*/
+int ocr_cache_save(Ocr_cache *cache, const char *file_name);
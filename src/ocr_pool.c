@@ -0,0 +1,859 @@
+/*
+ * Copyright 2017 sprin0
+ * 
+ * This file is part of JpnCap.
+ * 
+ * JpnCap is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * JpnCap is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with JpnCap.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+#include <tesseract/capi.h>
+
+#include "ocr_pool.h"
+#include "hashmap.h"
+
+#include "configuration.h"
+
+typedef struct Job Job;
+
+static inline size_t job_hash(Job *job) {
+	return hashmap_hash_int((uintptr_t)job);
+}
+
+HASHSET_DEFINE(Job_set, job_set, Job*, job_hash, HASHMAP_EQUALS_INT)
+
+/* The Tesseract languages for every text_ori. A single orientation only needs
+	its own model, which halves the work compared to trying both. Auto mode
+	uses the handles of both orientations and keeps the better result. */
+static const char *const languages[] = {
+	[TEXT_ORIENTATION_AUTO] = NULL,
+	[TEXT_ORIENTATION_VERTICAL] = "jpn_vert",
+	[TEXT_ORIENTATION_HORIZONTAL] = "jpn"
+};
+#define LANGUAGES_LENGTH (sizeof(languages) / sizeof(*languages))
+/* Fast leaves out the dictionaries, which also saves loading them */
+static const char *const fast_names[] = {"load_system_dawg", "load_freq_dawg"};
+static const char *const fast_values[] = {"0", "0"};
+
+static const ocr_pool_Profile profiles[] = {
+	[OCR_PROFILE_FAST] = {"fast", OEM_LSTM_ONLY, "tessdata_fast", fast_names,
+		fast_values, sizeof(fast_names) / sizeof(*fast_names), 28},
+	[OCR_PROFILE_BALANCED] = {"balanced", OEM_DEFAULT, NULL, NULL, NULL, 0,
+		RECOGNIZE_GLYPH_HEIGHT},
+	[OCR_PROFILE_ACCURATE] = {"accurate", OEM_LSTM_ONLY, "tessdata_best",
+		NULL, NULL, 0, 48}
+};
+
+/* Microseconds between checks whether a handle can still be expected */
+#define HANDLE_WAIT_INTERVAL 100000
+/* The handles kept for all profiles and orientations together besides one
+	for every worker, e.g. for the other orientation or the preliminary pass.
+	Every handle holds the models of a language, which take a few hundred
+	megabytes. */
+#define HANDLES_SPARE 2
+
+typedef struct {
+	/* The handles not in use */
+	GAsyncQueue *idle;
+	/* The number of handles initialized and of those still being
+		initialized, guarded by the lock of the pool */
+	int created;
+	int pending;
+} Handles;
+
+struct Ocr_pool {
+	GThreadPool *threads;
+	Handles handles[OCR_PROFILES_LENGTH][LANGUAGES_LENGTH];
+	/* The number of handles of all profiles and orientations, guarded by
+		lock */
+	int created;
+	int size;
+	/* Guarded by lock, only changed in the main loop */
+	ocr_profile profile;
+	int progressive;
+	/* NULL if recognized texts are not cached */
+	Ocr_cache *cache;
+	/* The jobs waiting to be delivered in the main loop and whether the pool
+		is destroyed, guarded by lock */
+	Job_set *finished;
+	int closing;
+	/* The progress of the last recognition queued, guarded by lock */
+	guint progress_id;
+	int progress;
+	GMutex lock;
+	guint last_id;
+	/* Recognitions with ids up to this are stopped, set atomically like the
+		deadline */
+	gint cancelled_id;
+	gint deadline;
+};
+
+struct Job {
+	Ocr_pool *pool;
+	guint id;
+	GdkPixbuf *pixbuf;
+	GdkRectangle rect;
+	int has_rect;
+	recognize_Preprocess preprocess;
+	int has_preprocess;
+	text_ori orientation;
+	ocr_profile profile;
+	/* Whether a preliminary pass is made and whether this is one */
+	int progressive;
+	int preliminary;
+	int remove_whitespaces;
+	Substitutions *substitutions;
+	void (*callback)(char *, guint, int, gpointer);
+	gpointer cb_data;
+	char *text;
+	int confidence;
+	/* Whether the recognition or a part of it was cancelled or ran out of
+		time, so that its text may be missing or incomplete */
+	int stopped;
+	gint64 start;
+	/* Set for the job of a whole capture if there is a cache */
+	recognize_Fingerprint fingerprint;
+	uint64_t settings;
+	int cached;
+	guint source_id;
+	/* Set for the jobs recognizing a part of another job */
+	struct Group *group;
+	size_t member;
+};
+
+typedef enum {
+	/* The members recognize the blocks of a capture */
+	GROUP_BLOCKS,
+	/* The members recognize a capture in every orientation */
+	GROUP_ORIENTATIONS
+} Group_kind;
+
+/* The jobs a job has been split into */
+typedef struct Group {
+	Job *job;
+	Group_kind kind;
+	char **texts;
+	int *confidences;
+	int *stopped;
+	/* Guarded by the lock of the pool */
+	int *progress;
+	size_t length;
+	gint remaining;
+} Group;
+
+TessBaseAPI *ocr_pool_handle_create(ocr_profile profile,
+	text_ori orientation) {
+	const ocr_pool_Profile *settings = profiles + profile;
+	const char *language = languages[orientation];
+	TessBaseAPI *handle;
+	char *models = NULL, *file_name;
+	int status;
+	gint64 start = g_get_monotonic_time();
+	
+	if (settings->models != NULL) {
+		models = g_build_filename(JPNCAP_RESOURCES_PATH, settings->models,
+			NULL);
+		file_name = g_strconcat(models, G_DIR_SEPARATOR_S, language,
+			".traineddata", NULL);
+		if (!g_file_test(file_name, G_FILE_TEST_EXISTS)) {
+			g_free(models);
+			models = NULL;
+		}
+		g_free(file_name);
+	}
+	
+	handle = TessBaseAPICreate();
+	status = TessBaseAPIInit4(handle, models, language, settings->engine_mode,
+		NULL, 0, (char**)settings->variable_names,
+		(char**)settings->variable_values, settings->variables_length, FALSE);
+	g_free(models);
+	if (status != 0) {
+		TessBaseAPIDelete(handle);
+		return NULL;
+	}
+	g_debug("ocr_pool: initialized tesseract for %s with the %s profile in "
+		"%.1f ms", language, settings->name,
+		(g_get_monotonic_time() - start) / 1000.0);
+	return handle;
+}
+
+void ocr_pool_handle_destroy(TessBaseAPI *handle) {
+	TessBaseAPIEnd(handle);
+	TessBaseAPIDelete(handle);
+}
+
+/** Returns whether the handles of profile are still used. The lock of pool
+	has to be held.
+*/
+static int pool_uses_profile(Ocr_pool *pool, ocr_profile profile) {
+	return profile == pool->profile
+		|| (pool->progressive && profile == OCR_PROFILE_FAST);
+}
+
+/** Removes an idle handle other than those of handles from pool to make room
+	for a new one, preferring handles of profiles not used anymore. Returns
+	NULL if all are in use. The lock of pool has to be held.
+*/
+static TessBaseAPI *pool_take_idle(Ocr_pool *pool, const Handles *handles) {
+	TessBaseAPI *handle;
+	size_t i, j;
+	int stale_only;
+	
+	for (stale_only = 1; stale_only >= 0; stale_only--) {
+		for (i = 0; i < OCR_PROFILES_LENGTH; i++) {
+			if (stale_only && pool_uses_profile(pool, i))
+				continue;
+			for (j = 0; j < LANGUAGES_LENGTH; j++) {
+				if (pool->handles[i] + j == handles || (handle =
+					g_async_queue_try_pop(pool->handles[i][j].idle)) == NULL)
+					continue;
+				pool->handles[i][j].created--;
+				pool->created--;
+				return handle;
+			}
+		}
+	}
+	return NULL;
+}
+
+/** Returns a handle for profile and orientation that is not in use. A new
+	one is initialized if all are busy, none is being initialized already and
+	there are less than the size of the pool. If the pool holds the most
+	handles of all profiles and orientations, an idle one of another is
+	freed for it. Returns NULL if no handle could be initialized.
+*/
+static TessBaseAPI *pool_take_handle(Ocr_pool *pool, ocr_profile profile,
+	text_ori orientation) {
+	Handles *handles = &pool->handles[profile][orientation];
+	TessBaseAPI *handle, *unused;
+	int create, created, failed = 0;
+	
+	if ((handle = g_async_queue_try_pop(handles->idle)) != NULL)
+		return handle;
+	
+	/* Another job returns its handle when it is done, and a handle being
+		initialized is waited for rather than initializing another, e.g. the
+		one of ocr_pool_preload. Handles of a profile that is not used
+		anymore are freed instead, which makes room for a new one. */
+	do {
+		unused = NULL;
+		g_mutex_lock(&pool->lock);
+		create = !failed && handles->pending == 0
+			&& handles->created < pool->size;
+		if (create && pool->created >= pool->size + HANDLES_SPARE)
+			create = (unused = pool_take_idle(pool, handles)) != NULL;
+		if (create) {
+			handles->created++;
+			handles->pending++;
+			pool->created++;
+		}
+		g_mutex_unlock(&pool->lock);
+		if (unused != NULL)
+			ocr_pool_handle_destroy(unused);
+		if (create) {
+			handle = ocr_pool_handle_create(profile, orientation);
+			g_mutex_lock(&pool->lock);
+			handles->pending--;
+			if (handle == NULL) {
+				handles->created--;
+				pool->created--;
+			}
+			g_mutex_unlock(&pool->lock);
+			if (handle != NULL)
+				return handle;
+			fprintf(stderr, "Could not initiate tesseract for %s with the "
+				"%s profile. Please check if tesseract and its Japanese "
+				"components are installed properly.\n",
+				languages[orientation], profiles[profile].name);
+			failed = 1;
+		}
+		/* Without a handle of its own, a handle of another profile or
+			orientation is waited for to make room */
+		g_mutex_lock(&pool->lock);
+		created = handles->created;
+		g_mutex_unlock(&pool->lock);
+		if (failed && created == 0)
+			return NULL;
+	} while ((handle = g_async_queue_timeout_pop(handles->idle,
+		HANDLE_WAIT_INTERVAL)) == NULL);
+	return handle;
+}
+
+/** Frees handle if the pool has switched to another profile, which a capture
+	is unlikely to be recognized with again soon.
+*/
+static void pool_return_handle(Ocr_pool *pool, ocr_profile profile,
+	text_ori orientation, TessBaseAPI *handle) {
+	Handles *handles = &pool->handles[profile][orientation];
+	int stale;
+	
+	g_mutex_lock(&pool->lock);
+	if ((stale = !pool_uses_profile(pool, profile))) {
+		handles->created--;
+		pool->created--;
+	}
+	g_mutex_unlock(&pool->lock);
+	if (stale)
+		ocr_pool_handle_destroy(handle);
+	else
+		g_async_queue_push(handles->idle, handle);
+}
+
+/** Frees the idle handles of the profiles not used anymore.
+*/
+static void pool_free_stale(Ocr_pool *pool) {
+	TessBaseAPI *handle;
+	int used;
+	size_t i, j;
+	
+	for (i = 0; i < OCR_PROFILES_LENGTH; i++) {
+		g_mutex_lock(&pool->lock);
+		used = pool_uses_profile(pool, i);
+		g_mutex_unlock(&pool->lock);
+		if (used)
+			continue;
+		for (j = 0; j < LANGUAGES_LENGTH; j++) {
+			while ((handle = g_async_queue_try_pop(
+				pool->handles[i][j].idle)) != NULL) {
+				
+				g_mutex_lock(&pool->lock);
+				pool->handles[i][j].created--;
+				pool->created--;
+				g_mutex_unlock(&pool->lock);
+				ocr_pool_handle_destroy(handle);
+			}
+		}
+	}
+}
+
+static gboolean job_deliver(gpointer data) {
+	Job *job = (Job*)data;
+	
+	g_mutex_lock(&job->pool->lock);
+	job_set_remove(job->pool->finished, job);
+	g_mutex_unlock(&job->pool->lock);
+	job->callback(job->text, job->id, !job->preliminary, job->cb_data);
+	free(job);
+	return G_SOURCE_REMOVE;
+}
+
+static void job_finish(Ocr_pool *pool, Job *job) {
+	g_mutex_lock(&pool->lock);
+	job->source_id = g_idle_add(job_deliver, job);
+	job_set_add(pool->finished, job);
+	g_mutex_unlock(&pool->lock);
+}
+
+/** Splits job into a group of kind and queues its members, one for every
+	block in blocks or one for every orientation. Returns 0 if the pool is
+	being destroyed, in which case job has to be done in one piece.
+*/
+static int job_split(Ocr_pool *pool, Job *job, Group_kind kind,
+	const Rectangle_vector *blocks) {
+	Group *group;
+	Job *member;
+	size_t i;
+	
+	g_mutex_lock(&pool->lock);
+	if (pool->closing) {
+		g_mutex_unlock(&pool->lock);
+		return 0;
+	}
+	group = malloc(sizeof(*group));
+	group->job = job;
+	group->kind = kind;
+	group->length = kind == GROUP_BLOCKS ? blocks->length : 2;
+	group->texts = calloc(group->length, sizeof(char*));
+	group->confidences = calloc(group->length, sizeof(int));
+	group->stopped = calloc(group->length, sizeof(int));
+	group->progress = calloc(group->length, sizeof(int));
+	group->remaining = group->length;
+	for (i = 0; i < group->length; i++) {
+		member = malloc(sizeof(*member));
+		*member = *job;
+		if (kind == GROUP_BLOCKS) {
+			member->rect = blocks->data[i];
+			member->has_rect = 1;
+		} else
+			member->orientation = i == 0 ? TEXT_ORIENTATION_VERTICAL
+				: TEXT_ORIENTATION_HORIZONTAL;
+		member->pixbuf = g_object_ref(job->pixbuf);
+		member->group = group;
+		member->member = i;
+		g_thread_pool_push(pool->threads, member, NULL);
+	}
+	g_mutex_unlock(&pool->lock);
+	g_object_unref(job->pixbuf);
+	return 1;
+}
+
+/** Joins the texts of group in order, leaving out members that failed.
+	Returns NULL if all failed.
+*/
+static char *group_join(Group *group, const char *separator) {
+	char *text = NULL, *pos;
+	size_t i, len = 0, separator_len = strlen(separator);
+	
+	for (i = 0; i < group->length; i++)
+		if (group->texts[i] != NULL)
+			len += strlen(group->texts[i]) + separator_len;
+	if (len == 0)
+		return NULL;
+	
+	pos = text = malloc(len + 1);
+	for (i = 0; i < group->length; i++) {
+		if (group->texts[i] == NULL)
+			continue;
+		if (pos != text) {
+			strcpy(pos, separator);
+			pos += separator_len;
+		}
+		strcpy(pos, group->texts[i]);
+		pos += strlen(pos);
+	}
+	return text;
+}
+
+/** Sets the text of the job of group to the one of the member that
+	Tesseract is most confident in.
+*/
+static void group_pick(Group *group) {
+	size_t i, best = group->length;
+	
+	for (i = 0; i < group->length; i++) {
+		if (group->texts[i] != NULL && (best == group->length
+			|| group->confidences[i] > group->confidences[best]))
+			best = i;
+	}
+	if (best == group->length)
+		return;
+	group->job->text = group->texts[best];
+	group->job->confidence = group->confidences[best];
+	group->texts[best] = NULL;
+}
+
+static void job_done(Ocr_pool *pool, Job *job);
+
+/** Stores the result of member in its group. The last member to finish
+	completes the job of the group.
+*/
+static void member_done(Ocr_pool *pool, Job *member) {
+	Group *group = member->group;
+	size_t i;
+	
+	group->texts[member->member] = member->text;
+	group->confidences[member->member] = member->confidence;
+	group->stopped[member->member] = member->stopped;
+	free(member);
+	if (!g_atomic_int_dec_and_test(&group->remaining))
+		return;
+	
+	for (i = 0; i < group->length; i++)
+		group->job->stopped |= group->stopped[i];
+	if (group->kind == GROUP_BLOCKS) {
+		/* Whitespaces between the blocks are removed like those in them.
+			Without the text of a block, the capture counts as not
+			recognized rather than giving a text with a gap. */
+		if (!group->job->stopped)
+			group->job->text = group_join(group,
+				group->job->remove_whitespaces ? "" : "\n");
+	} else {
+		group_pick(group);
+		g_debug("ocr_pool: confidence vertical %d, horizontal %d",
+			group->confidences[0], group->confidences[1]);
+	}
+	for (i = 0; i < group->length; i++)
+		free(group->texts[i]);
+	free(group->texts);
+	free(group->confidences);
+	free(group->stopped);
+	free(group->progress);
+	job_done(pool, group->job);
+	free(group);
+}
+
+static void job_done(Ocr_pool *pool, Job *job) {
+	if (job->group != NULL) {
+		member_done(pool, job);
+		return;
+	}
+	g_debug("ocr_pool: %s in %.1f ms with the %s profile%s",
+		job->cached ? "found in the cache" : job->text != NULL ? "recognized"
+		: "not recognized",
+		(g_get_monotonic_time() - job->start) / 1000.0,
+		profiles[job->profile].name, job->preliminary ? ", preliminary" : "");
+	/* A text that may be incomplete would be found again and again */
+	if (pool->cache != NULL && !job->cached && !job->preliminary
+		&& !job->stopped && job->text != NULL)
+		ocr_cache_add(pool->cache, &job->fingerprint, job->settings,
+			job->text, g_get_monotonic_time() - job->start);
+	job_finish(pool, job);
+}
+
+/** Looks up the text of job in the cache of pool. Returns whether it was
+	found.
+*/
+static int job_lookup(Ocr_pool *pool, Job *job) {
+	ocr_cache_Stats stats;
+	gint64 start = g_get_monotonic_time();
+	
+	recognize_fingerprint(job->pixbuf, job->has_rect ? &job->rect : NULL,
+		&job->fingerprint);
+	job->text = ocr_cache_lookup(pool->cache, &job->fingerprint,
+		job->settings);
+	job->cached = job->text != NULL;
+	
+	ocr_cache_get_stats(pool->cache, &stats);
+	g_debug("ocr_pool: cache %s in %.1f ms, %lu hits, %lu misses, %.1f s "
+		"saved", job->cached ? "hit" : "miss",
+		(g_get_monotonic_time() - start) / 1000.0, stats.hits, stats.misses,
+		stats.time_saved / 1000000.0);
+	return job->cached;
+}
+
+static int job_cancelled(gpointer data) {
+	Job *job = (Job*)data;
+	
+	return job->id <= (guint)g_atomic_int_get(&job->pool->cancelled_id);
+}
+
+/** Sets the progress of job and of the jobs it is a part of, if it belongs to
+	the recognition whose progress is followed.
+*/
+static void job_progress(int progress, gpointer data) {
+	Job *job = (Job*)data;
+	Ocr_pool *pool = job->pool;
+	Group *group;
+	size_t i;
+	
+	g_mutex_lock(&pool->lock);
+	if (job->id == pool->progress_id && !job->preliminary) {
+		while ((group = job->group) != NULL) {
+			group->progress[job->member] = progress;
+			for (progress = 0, i = 0; i < group->length; i++)
+				progress += group->progress[i];
+			progress /= group->length;
+			job = group->job;
+		}
+		pool->progress = progress;
+	}
+	g_mutex_unlock(&pool->lock);
+}
+
+static void job_run(gpointer data, gpointer pdata);
+
+/** Queues a quick recognition of job in one orientation with the fast
+	profile, whose text is delivered ahead of the one of job. If the pool has
+	a single thread, it is made right away, as it would wait for job
+	otherwise.
+*/
+static void job_queue_preliminary(Ocr_pool *pool, Job *job) {
+	Job *quick;
+	
+	quick = malloc(sizeof(*quick));
+	*quick = *job;
+	quick->pixbuf = g_object_ref(job->pixbuf);
+	quick->profile = OCR_PROFILE_FAST;
+	quick->preprocess.glyph_height = profiles[OCR_PROFILE_FAST].glyph_height;
+	quick->progressive = 0;
+	quick->preliminary = 1;
+	if (pool->size == 1) {
+		job_run(quick, pool);
+		return;
+	}
+	
+	g_mutex_lock(&pool->lock);
+	if (!pool->closing) {
+		g_thread_pool_push(pool->threads, quick, NULL);
+		quick = NULL;
+	}
+	g_mutex_unlock(&pool->lock);
+	if (quick != NULL) {
+		g_object_unref(quick->pixbuf);
+		free(quick);
+	}
+}
+
+static void job_run(gpointer data, gpointer pdata) {
+	Job *job = (Job*)data;
+	Ocr_pool *pool = (Ocr_pool*)pdata;
+	const GdkRectangle *rect = job->has_rect ? &job->rect : NULL;
+	recognize_Control control = {job_cancelled, job_progress, job, 0};
+	recognize_Timing timing;
+	TessBaseAPI *handle;
+	Rectangle_vector *blocks;
+	int closing;
+	
+	/* Only makes sure that there is a handle for the orientation, which is
+		not needed anymore once the pool is destroyed */
+	if (job->pixbuf == NULL) {
+		g_mutex_lock(&pool->lock);
+		closing = pool->closing;
+		g_mutex_unlock(&pool->lock);
+		if (closing) {
+			free(job);
+			return;
+		}
+		pool_free_stale(pool);
+		if ((handle = pool_take_handle(pool, job->profile, job->orientation))
+			!= NULL)
+			pool_return_handle(pool, job->profile, job->orientation, handle);
+		free(job);
+		return;
+	}
+	
+	if (job->group == NULL)
+		job->start = g_get_monotonic_time();
+	if ((job->stopped = job_cancelled(job)) || (job->group == NULL
+		&& !job->preliminary && pool->cache != NULL
+		&& job_lookup(pool, job))) {
+		
+		g_object_unref(job->pixbuf);
+		job_done(pool, job);
+		return;
+	}
+	/* A quick pass shows a first text while the capture is recognized */
+	if (job->group == NULL && job->progressive)
+		job_queue_preliminary(pool, job);
+	
+	/* Large captures are split into blocks recognized by several workers */
+	if (job->group == NULL && !job->preliminary && pool->size > 1 && (blocks =
+		recognize_find_blocks(job->pixbuf, rect, job->orientation)) != NULL) {
+		
+		g_debug("ocr_pool: split into %u blocks after %.1f ms",
+			(unsigned)blocks->length,
+			(g_get_monotonic_time() - job->start) / 1000.0);
+		if (job_split(pool, job, GROUP_BLOCKS, blocks)) {
+			rectangle_vector_destroy(blocks);
+			return;
+		}
+		rectangle_vector_destroy(blocks);
+	}
+	
+	/* Both orientations are tried unless the layout tells which it is */
+	if (job->orientation == TEXT_ORIENTATION_AUTO) {
+		job->orientation = recognize_guess_orientation(job->pixbuf, rect);
+		if (job->orientation == TEXT_ORIENTATION_AUTO) {
+			if (!job->preliminary
+				&& job_split(pool, job, GROUP_ORIENTATIONS, NULL))
+				return;
+			job->orientation = TEXT_ORIENTATION_VERTICAL;
+		}
+	}
+	
+	if ((handle = pool_take_handle(pool, job->profile, job->orientation))
+		!= NULL) {
+		
+		control.deadline = g_atomic_int_get(&pool->deadline);
+		job->text = processPixbuf(job->pixbuf, rect,
+			job->has_preprocess ? &job->preprocess : NULL, job->orientation,
+			job->remove_whitespaces, handle, job->substitutions, &control,
+			&timing, &job->confidence);
+		pool_return_handle(pool, job->profile, job->orientation, handle);
+		/* Tesseract may also end early with what it has by then */
+		job->stopped = job_cancelled(job) || (control.deadline > 0
+			&& timing.recognize >= control.deadline * (gint64)1000);
+	}
+	g_object_unref(job->pixbuf);
+	job_done(pool, job);
+}
+
+/** Returns a hash of all settings that change the text recognized in a
+	capture.
+*/
+static uint64_t settings_hash(const recognize_Preprocess *preprocess,
+	text_ori orientation, ocr_profile profile, int remove_whitespaces,
+	const Substitutions *substitutions) {
+	uint64_t hash;
+	size_t i;
+	
+	hash = hashmap_hash_string(TessVersion());
+	hash = hashmap_hash_int(hash + orientation);
+	hash = hashmap_hash_int(hash + profile);
+	hash = hashmap_hash_int(hash + (remove_whitespaces != 0));
+	if (preprocess != NULL && preprocess->enabled) {
+		hash = hashmap_hash_int(hash + (preprocess->crop != 0));
+		hash = hashmap_hash_int(hash + preprocess->glyph_height);
+		hash = hashmap_hash_int(hash + preprocess->binarize);
+	}
+	for (i = 0; i < substitutions->rules->length; i++) {
+		hash = hashmap_hash_int(hash
+			+ hashmap_hash_string(substitutions->rules->data[i].from));
+		hash = hashmap_hash_int(hash
+			+ hashmap_hash_string(substitutions->rules->data[i].to));
+	}
+	return hash;
+}
+
+const ocr_pool_Profile *ocr_pool_get_profile(ocr_profile profile) {
+	return profiles + profile;
+}
+
+Ocr_pool *ocr_pool_create(int size, Ocr_cache *cache) {
+	Ocr_pool *pool;
+	size_t i, j;
+	
+	pool = malloc(sizeof(*pool));
+	for (i = 0; i < OCR_PROFILES_LENGTH; i++) {
+		for (j = 0; j < LANGUAGES_LENGTH; j++) {
+			pool->handles[i][j].idle = g_async_queue_new();
+			pool->handles[i][j].created = 0;
+			pool->handles[i][j].pending = 0;
+		}
+	}
+	pool->created = 0;
+	pool->size = MAX(1, size);
+	pool->profile = OCR_PROFILE_BALANCED;
+	pool->progressive = 0;
+	pool->cache = cache;
+	pool->finished = job_set_create();
+	pool->closing = 0;
+	pool->progress_id = 0;
+	pool->progress = 0;
+	g_mutex_init(&pool->lock);
+	pool->last_id = 0;
+	pool->cancelled_id = 0;
+	pool->deadline = 0;
+	pool->threads = g_thread_pool_new(job_run, pool, pool->size, FALSE, NULL);
+	return pool;
+}
+
+void ocr_pool_destroy(Ocr_pool *pool) {
+	TessBaseAPI *handle;
+	Job_set_entry *entry;
+	size_t i, j, pos = 0;
+	
+	/* No more members of groups are queued from here on, and queued handles
+		are not initialized anymore */
+	g_mutex_lock(&pool->lock);
+	pool->closing = 1;
+	g_mutex_unlock(&pool->lock);
+	/* The queued jobs end right away and the running ones as soon as
+		Tesseract notices, which is waited for */
+	ocr_pool_cancel(pool, pool->last_id);
+	g_thread_pool_free(pool->threads, FALSE, TRUE);
+	while ((entry = job_set_next(pool->finished, &pos)) != NULL) {
+		g_source_remove(entry->key->source_id);
+		free(entry->key->text);
+		free(entry->key);
+	}
+	job_set_destroy(pool->finished);
+	for (i = 0; i < OCR_PROFILES_LENGTH; i++) {
+		for (j = 0; j < LANGUAGES_LENGTH; j++) {
+			while ((handle = g_async_queue_try_pop(pool->handles[i][j].idle))
+				!= NULL)
+				ocr_pool_handle_destroy(handle);
+			g_async_queue_unref(pool->handles[i][j].idle);
+		}
+	}
+	g_mutex_clear(&pool->lock);
+	free(pool);
+}
+
+void ocr_pool_set_profile(Ocr_pool *pool, ocr_profile profile) {
+	g_mutex_lock(&pool->lock);
+	pool->profile = profile;
+	g_mutex_unlock(&pool->lock);
+}
+
+void ocr_pool_set_deadline(Ocr_pool *pool, int deadline) {
+	g_atomic_int_set(&pool->deadline, deadline);
+}
+
+void ocr_pool_set_progressive(Ocr_pool *pool, int progressive) {
+	g_mutex_lock(&pool->lock);
+	pool->progressive = progressive;
+	g_mutex_unlock(&pool->lock);
+}
+
+static void preload(Ocr_pool *pool, ocr_profile profile,
+	text_ori orientation) {
+	Job *job;
+	
+	job = calloc(1, sizeof(*job));
+	job->pool = pool;
+	job->orientation = orientation;
+	job->profile = profile;
+	g_thread_pool_push(pool->threads, job, NULL);
+}
+
+void ocr_pool_preload(Ocr_pool *pool, text_ori orientation) {
+	if (orientation == TEXT_ORIENTATION_AUTO) {
+		ocr_pool_preload(pool, TEXT_ORIENTATION_VERTICAL);
+		ocr_pool_preload(pool, TEXT_ORIENTATION_HORIZONTAL);
+		return;
+	}
+	if (pool->progressive && pool->profile != OCR_PROFILE_FAST)
+		preload(pool, OCR_PROFILE_FAST, orientation);
+	preload(pool, pool->profile, orientation);
+}
+
+guint ocr_pool_recognize(Ocr_pool *pool, GdkPixbuf *pixbuf,
+	const GdkRectangle *rect, const recognize_Preprocess *preprocess,
+	text_ori orientation, int remove_whitespaces,
+	Substitutions *substitutions,
+	void (*callback)(char *, guint, int, gpointer), gpointer cb_data) {
+	Job *job;
+	
+	job = malloc(sizeof(*job));
+	job->pool = pool;
+	job->id = ++pool->last_id;
+	job->pixbuf = g_object_ref(pixbuf);
+	job->has_rect = rect != NULL;
+	if (rect != NULL)
+		job->rect = *rect;
+	job->has_preprocess = preprocess != NULL;
+	if (preprocess != NULL)
+		job->preprocess = *preprocess;
+	job->orientation = orientation;
+	job->profile = pool->profile;
+	job->progressive = pool->progressive && pool->profile != OCR_PROFILE_FAST;
+	job->preliminary = 0;
+	job->remove_whitespaces = remove_whitespaces;
+	job->substitutions = substitutions;
+	job->callback = callback;
+	job->cb_data = cb_data;
+	job->text = NULL;
+	job->confidence = 0;
+	job->stopped = 0;
+	job->settings = settings_hash(preprocess, orientation, job->profile,
+		remove_whitespaces, substitutions);
+	job->cached = 0;
+	job->group = NULL;
+	job->member = 0;
+	
+	g_mutex_lock(&pool->lock);
+	pool->progress_id = job->id;
+	pool->progress = 0;
+	g_mutex_unlock(&pool->lock);
+	g_thread_pool_push(pool->threads, job, NULL);
+	return job->id;
+}
+
+void ocr_pool_cancel(Ocr_pool *pool, guint id) {
+	if (id > (guint)g_atomic_int_get(&pool->cancelled_id))
+		g_atomic_int_set(&pool->cancelled_id, id);
+}
+
+int ocr_pool_get_progress(Ocr_pool *pool, guint id) {
+	int progress;
+	
+	g_mutex_lock(&pool->lock);
+	progress = id == pool->progress_id ? pool->progress : -1;
+	g_mutex_unlock(&pool->lock);
+	return progress;
+}
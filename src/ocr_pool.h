@@ -0,0 +1,137 @@
+/*
+ * Copyright 2017 sprin0
+ * 
+ * This file is part of JpnCap.
+ * 
+ * JpnCap is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * JpnCap is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with JpnCap.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <gdk/gdk.h>
+
+#include "recognize.h"
+#include "ocr_cache.h"
+
+/* The most Tesseract handles per text orientation, and so of captures or
+	blocks of a capture recognized at once */
+#define OCR_POOL_SIZE_MAX 4
+
+typedef enum {
+	OCR_PROFILE_FAST,
+	OCR_PROFILE_BALANCED,
+	OCR_PROFILE_ACCURATE
+} ocr_profile;
+
+#define OCR_PROFILES_LENGTH 3
+
+/** How Tesseract is set up for a profile. models is a directory in the
+	resources path with a variant of the models, like those of tessdata_fast
+	or tessdata_best, which is used if it holds the model of a language.
+	Otherwise, or if models is NULL, the models Tesseract finds by itself are
+	used. The variables are set on initialization, variable_names[i] to
+	variable_values[i]. glyph_height is meant for recognize_Preprocess.
+*/
+typedef struct {
+	const char *name;
+	TessOcrEngineMode engine_mode;
+	const char *models;
+	const char *const *variable_names;
+	const char *const *variable_values;
+	size_t variables_length;
+	int glyph_height;
+} ocr_pool_Profile;
+
+/** A set of Tesseract handles that recognize captures on worker threads. Every
+	text orientation has handles with only the models it needs, which are
+	initialized when the first capture or ocr_pool_preload needs them, and
+	more when captures come in faster than they are recognized. The pool
+	holds at most two handles more than it has workers, for all profiles and
+	orientations together, and frees idle ones to make room.
+*/
+typedef struct Ocr_pool Ocr_pool;
+
+/** Returns the settings of profile.
+*/
+const ocr_pool_Profile *ocr_pool_get_profile(ocr_profile profile);
+/** Initializes a Tesseract handle for profile with the models for
+	orientation, which must not be TEXT_ORIENTATION_AUTO. Returns NULL on
+	failure.
+*/
+TessBaseAPI *ocr_pool_handle_create(ocr_profile profile,
+	text_ori orientation);
+void ocr_pool_handle_destroy(TessBaseAPI *handle);
+/** Creates a pool of up to size handles per orientation. No handle is
+	initialized yet. If cache is not NULL, recognized texts are looked up in
+	and added to it.
+*/
+Ocr_pool *ocr_pool_create(int size, Ocr_cache *cache);
+/** Stops all pending recognitions, waits for them to end and frees pool.
+	The callbacks of recognitions that have not been delivered yet are not
+	called anymore.
+*/
+void ocr_pool_destroy(Ocr_pool *pool);
+/** Makes the pool recognize the following captures with the handles of
+	profile. The handles of other profiles are freed once they are not in use
+	anymore. The pool starts with OCR_PROFILE_BALANCED.
+*/
+void ocr_pool_set_profile(Ocr_pool *pool, ocr_profile profile);
+/** Makes the pool recognize the following captures progressively if
+	progressive is nonzero: a quick pass with the fast profile in a single
+	orientation delivers a first text, which the text of the current profile
+	follows. The handles of the fast profile are kept for that.
+*/
+void ocr_pool_set_progressive(Ocr_pool *pool, int progressive);
+/** Stops every recognition that takes longer than deadline milliseconds in
+	Tesseract, or none if deadline is 0, which is the default. Blocks of a
+	capture and orientations tried at once have a deadline each. A capture
+	of which a block was stopped is not recognized, and texts of stopped
+	recognitions are not cached.
+*/
+void ocr_pool_set_deadline(Ocr_pool *pool, int deadline);
+/** Initializes a handle for orientation on a worker thread unless there is one
+	already, so that the next capture does not wait for it. Idle handles of
+	profiles other than the current one are freed there as well.
+*/
+void ocr_pool_preload(Ocr_pool *pool, text_ori orientation);
+/** Recognizes the text in the part rect of pixbuf on a worker thread like
+	processPixbuf. Large captures are split into blocks by
+	recognize_find_blocks, which are recognized at once if the pool has more
+	than one handle. The current profile of the pool is used. In auto
+	orientation, the text is recognized as vertical and as horizontal at once
+	and the result with the higher confidence is kept, unless
+	recognize_guess_orientation can tell the orientation.
+	pixbuf is referenced and rect and preprocess are copied, but substitutions
+	must stay valid until callback is called.
+	callback is called in the main loop with the text, which it has to free,
+	or NULL on failure, e.g. if Tesseract could not be initialized, with the
+	id this function returned and whether the text is final. Ids increase
+	with every call. When recognizing progressively, callback is called
+	twice, first with the preliminary text. That may come after the final
+	text though, e.g. if the final text was cached.
+*/
+guint ocr_pool_recognize(Ocr_pool *pool, GdkPixbuf *pixbuf,
+	const GdkRectangle *rect, const recognize_Preprocess *preprocess,
+	text_ori orientation, int remove_whitespaces,
+	Substitutions *substitutions,
+	void (*callback)(char *, guint, int, gpointer), gpointer cb_data);
+/** Stops the recognitions with ids up to id. Their handles are returned to
+	the pool as soon as Tesseract notices, and their callbacks are called
+	with NULL.
+*/
+void ocr_pool_cancel(Ocr_pool *pool, guint id);
+/** Returns the progress of the recognition id from 0 to 100, or -1 if it is
+	not the one queued last. Only the progress of that one is followed.
+*/
+int ocr_pool_get_progress(Ocr_pool *pool, guint id);
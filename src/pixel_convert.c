@@ -0,0 +1,390 @@
+/*
+ * Copyright 2017 sprin0
+ * 
+ * This file is part of JpnCap.
+ * 
+ * JpnCap is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * JpnCap is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with JpnCap.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "pixel_convert.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define PIXEL_CONVERT_X86
+#include <immintrin.h>
+#endif
+
+/* Weights of red, green and blue for the grayscale conversion, they add up to
+	128. */
+#define GRAY_WEIGHT_R 38
+#define GRAY_WEIGHT_G 75
+#define GRAY_WEIGHT_B 15
+
+/* Leptonica keeps 32 bpp pixels as 0xRRGGBB00 words. 8 bpp pixels are packed
+	into words from the most significant byte on. Building the words with
+	shifts makes this independent of the byte order. */
+
+static void convert_row_rgb_scalar(const unsigned char *src, uint32_t *dst,
+	int width, int n_channels) {
+	int x;
+	
+	for (x = 0; x < width; x++, src += n_channels)
+		dst[x] = (uint32_t)src[0] << 24 | (uint32_t)src[1] << 16
+			| (uint32_t)src[2] << 8;
+}
+
+static inline uint32_t gray_value(const unsigned char *pixel) {
+	return (GRAY_WEIGHT_R * pixel[0] + GRAY_WEIGHT_G * pixel[1]
+		+ GRAY_WEIGHT_B * pixel[2] + 64) >> 7;
+}
+
+static void convert_row_gray_scalar(const unsigned char *src, uint32_t *dst,
+	int width, int n_channels) {
+	uint32_t word = 0;
+	int x;
+	
+	for (x = 0; x < width; x++, src += n_channels) {
+		word = word << 8 | gray_value(src);
+		if ((x & 3) == 3) {
+			dst[x >> 2] = word;
+			word = 0;
+		}
+	}
+	if (x & 3)
+		dst[x >> 2] = word << 8 * (4 - (x & 3));
+}
+
+static void convert_row_xrgb_scalar(const uint32_t *src, unsigned char *dst,
+	int width) {
+	int x;
+	
+	for (x = 0; x < width; x++, dst += 3) {
+		dst[0] = src[x] >> 16;
+		dst[1] = src[x] >> 8;
+		dst[2] = src[x];
+	}
+}
+
+static uint64_t row_difference_scalar(const unsigned char *a,
+	const unsigned char *b, int length) {
+	uint64_t sum = 0;
+	int i;
+	
+	for (i = 0; i < length; i++)
+		sum += a[i] > b[i] ? a[i] - b[i] : b[i] - a[i];
+	return sum;
+}
+
+#ifdef PIXEL_CONVERT_X86
+
+/* Shuffles that turn 4 RGB or RGBA pixels into 4 little endian 0xRRGGBB00
+	words */
+static const char SHUFFLE_RGB[2][16] = {
+	{-1, 2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9},
+	{-1, 2, 1, 0, -1, 6, 5, 4, -1, 10, 9, 8, -1, 14, 13, 12}
+};
+/* Shuffles that spread 4 RGB or RGBA pixels to R, G, B, 0 for weighting */
+static const char SHUFFLE_GRAY[2][16] = {
+	{0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1},
+	{0, 1, 2, -1, 4, 5, 6, -1, 8, 9, 10, -1, 12, 13, 14, -1}
+};
+static const char GRAY_WEIGHTS[16] = {
+	GRAY_WEIGHT_R, GRAY_WEIGHT_G, GRAY_WEIGHT_B, 0,
+	GRAY_WEIGHT_R, GRAY_WEIGHT_G, GRAY_WEIGHT_B, 0,
+	GRAY_WEIGHT_R, GRAY_WEIGHT_G, GRAY_WEIGHT_B, 0,
+	GRAY_WEIGHT_R, GRAY_WEIGHT_G, GRAY_WEIGHT_B, 0
+};
+/* Reverses the bytes of every word to put 8 bpp pixels in Leptonica's order */
+static const char SHUFFLE_WORD_BYTES[16] = {
+	3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12
+};
+
+/* Packs the R, G and B of 4 little endian 0xXXRRGGBB words into 12 bytes */
+static const char SHUFFLE_XRGB[16] = {
+	2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1
+};
+
+/* Reading 16 bytes for 4 RGB pixels reads 4 bytes too much, so the vector
+	loops stop early enough to stay inside the row. */
+
+__attribute__((target("ssse3")))
+static int convert_row_rgb_ssse3(const unsigned char *src, uint32_t *dst,
+	int width, int n_channels) {
+	const __m128i shuffle = _mm_loadu_si128(
+		(const __m128i*)SHUFFLE_RGB[n_channels - 3]);
+	int x;
+	
+	for (x = 0; x + 4 + (n_channels == 3 ? 2 : 0) <= width; x += 4) {
+		_mm_storeu_si128((__m128i*)(dst + x), _mm_shuffle_epi8(
+			_mm_loadu_si128((const __m128i*)(src + x * n_channels)),
+			shuffle));
+	}
+	return x;
+}
+
+__attribute__((target("avx2")))
+static inline __m256i load_8_pixels(const unsigned char *src,
+	int n_channels) {
+	return _mm256_inserti128_si256(_mm256_castsi128_si256(
+		_mm_loadu_si128((const __m128i*)src)),
+		_mm_loadu_si128((const __m128i*)(src + 4 * n_channels)), 1);
+}
+
+__attribute__((target("avx2")))
+static int convert_row_rgb_avx2(const unsigned char *src, uint32_t *dst,
+	int width, int n_channels) {
+	const __m256i shuffle = _mm256_broadcastsi128_si256(_mm_loadu_si128(
+		(const __m128i*)SHUFFLE_RGB[n_channels - 3]));
+	int x;
+	
+	for (x = 0; x + 8 + (n_channels == 3 ? 2 : 0) <= width; x += 8) {
+		_mm256_storeu_si256((__m256i*)(dst + x), _mm256_shuffle_epi8(
+			load_8_pixels(src + x * n_channels, n_channels), shuffle));
+	}
+	return x;
+}
+
+/* 4 packed pixels take 12 bytes, so the XRGB kernel joins them into whole
+	vectors before storing to write nothing after the row. There is no AVX2
+	kernel, since it was not faster at copying a captured screen. */
+
+__attribute__((target("ssse3")))
+static int convert_row_xrgb_ssse3(const uint32_t *src, unsigned char *dst,
+	int width) {
+	const __m128i shuffle = _mm_loadu_si128((const __m128i*)SHUFFLE_XRGB);
+	__m128i a, b, c, d;
+	int x;
+	
+	for (x = 0; x + 16 <= width; x += 16) {
+		a = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(src + x)),
+			shuffle);
+		b = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(src + x + 4)),
+			shuffle);
+		c = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(src + x + 8)),
+			shuffle);
+		d = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(src + x + 12)),
+			shuffle);
+		_mm_storeu_si128((__m128i*)(dst + 3 * x),
+			_mm_or_si128(a, _mm_slli_si128(b, 12)));
+		_mm_storeu_si128((__m128i*)(dst + 3 * x + 16),
+			_mm_or_si128(_mm_srli_si128(b, 4), _mm_slli_si128(c, 8)));
+		_mm_storeu_si128((__m128i*)(dst + 3 * x + 32),
+			_mm_or_si128(_mm_srli_si128(c, 8), _mm_slli_si128(d, 4)));
+	}
+	return x;
+}
+
+__attribute__((target("ssse3")))
+static inline __m128i weigh_4_pixels(const unsigned char *src,
+	__m128i shuffle, __m128i weights) {
+	return _mm_maddubs_epi16(_mm_shuffle_epi8(
+		_mm_loadu_si128((const __m128i*)src), shuffle), weights);
+}
+
+__attribute__((target("ssse3")))
+static int convert_row_gray_ssse3(const unsigned char *src, uint32_t *dst,
+	int width, int n_channels) {
+	const __m128i shuffle = _mm_loadu_si128(
+		(const __m128i*)SHUFFLE_GRAY[n_channels - 3]);
+	const __m128i weights = _mm_loadu_si128((const __m128i*)GRAY_WEIGHTS);
+	const __m128i word_bytes = _mm_loadu_si128(
+		(const __m128i*)SHUFFLE_WORD_BYTES);
+	const __m128i round = _mm_set1_epi16(64);
+	__m128i low, high;
+	int x;
+	
+	for (x = 0; x + 16 + (n_channels == 3 ? 2 : 0) <= width; x += 16) {
+		low = _mm_hadd_epi16(
+			weigh_4_pixels(src + x * n_channels, shuffle, weights),
+			weigh_4_pixels(src + (x + 4) * n_channels, shuffle, weights));
+		high = _mm_hadd_epi16(
+			weigh_4_pixels(src + (x + 8) * n_channels, shuffle, weights),
+			weigh_4_pixels(src + (x + 12) * n_channels, shuffle, weights));
+		low = _mm_srli_epi16(_mm_add_epi16(low, round), 7);
+		high = _mm_srli_epi16(_mm_add_epi16(high, round), 7);
+		_mm_storeu_si128((__m128i*)(dst + x / 4), _mm_shuffle_epi8(
+			_mm_packus_epi16(low, high), word_bytes));
+	}
+	return x;
+}
+
+__attribute__((target("avx2")))
+static inline __m256i weigh_8_pixels(const unsigned char *src,
+	int n_channels, __m256i shuffle, __m256i weights) {
+	return _mm256_maddubs_epi16(_mm256_shuffle_epi8(
+		load_8_pixels(src, n_channels), shuffle), weights);
+}
+
+__attribute__((target("avx2")))
+static int convert_row_gray_avx2(const unsigned char *src, uint32_t *dst,
+	int width, int n_channels) {
+	const __m256i shuffle = _mm256_broadcastsi128_si256(_mm_loadu_si128(
+		(const __m128i*)SHUFFLE_GRAY[n_channels - 3]));
+	const __m256i weights = _mm256_broadcastsi128_si256(_mm_loadu_si128(
+		(const __m128i*)GRAY_WEIGHTS));
+	const __m256i word_bytes = _mm256_broadcastsi128_si256(_mm_loadu_si128(
+		(const __m128i*)SHUFFLE_WORD_BYTES));
+	/* The lanes are handled separately, this restores the pixel order */
+	const __m256i word_order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+	const __m256i round = _mm256_set1_epi16(64);
+	__m256i low, high;
+	int x;
+	
+	for (x = 0; x + 32 + (n_channels == 3 ? 2 : 0) <= width; x += 32) {
+		low = _mm256_hadd_epi16(
+			weigh_8_pixels(src + x * n_channels, n_channels, shuffle,
+				weights),
+			weigh_8_pixels(src + (x + 8) * n_channels, n_channels, shuffle,
+				weights));
+		high = _mm256_hadd_epi16(
+			weigh_8_pixels(src + (x + 16) * n_channels, n_channels, shuffle,
+				weights),
+			weigh_8_pixels(src + (x + 24) * n_channels, n_channels, shuffle,
+				weights));
+		low = _mm256_srli_epi16(_mm256_add_epi16(low, round), 7);
+		high = _mm256_srli_epi16(_mm256_add_epi16(high, round), 7);
+		_mm256_storeu_si256((__m256i*)(dst + x / 4), _mm256_shuffle_epi8(
+			_mm256_permutevar8x32_epi32(_mm256_packus_epi16(low, high),
+				word_order), word_bytes));
+	}
+	return x;
+}
+
+/* The sums of absolute differences of 8 bytes each are added up in 64 bit
+	lanes, which cannot overflow for any row. */
+
+__attribute__((target("sse2")))
+static int row_difference_sse2(const unsigned char *a, const unsigned char *b,
+	int length, uint64_t *sum) {
+	__m128i total = _mm_setzero_si128();
+	uint64_t lanes[2];
+	int i;
+	
+	for (i = 0; i + 16 <= length; i += 16) {
+		total = _mm_add_epi64(total, _mm_sad_epu8(
+			_mm_loadu_si128((const __m128i*)(a + i)),
+			_mm_loadu_si128((const __m128i*)(b + i))));
+	}
+	_mm_storeu_si128((__m128i*)lanes, total);
+	*sum = lanes[0] + lanes[1];
+	return i;
+}
+
+__attribute__((target("avx2")))
+static int row_difference_avx2(const unsigned char *a, const unsigned char *b,
+	int length, uint64_t *sum) {
+	__m256i total = _mm256_setzero_si256();
+	uint64_t lanes[4];
+	int i;
+	
+	for (i = 0; i + 32 <= length; i += 32) {
+		total = _mm256_add_epi64(total, _mm256_sad_epu8(
+			_mm256_loadu_si256((const __m256i*)(a + i)),
+			_mm256_loadu_si256((const __m256i*)(b + i))));
+	}
+	_mm256_storeu_si256((__m256i*)lanes, total);
+	*sum = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+	return i;
+}
+
+enum {
+	CPU_UNKNOWN,
+	CPU_SCALAR,
+	CPU_SSSE3,
+	CPU_AVX2
+};
+
+static int cpu_level(void) {
+	static int level = CPU_UNKNOWN;
+	
+	if (level == CPU_UNKNOWN) {
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("avx2"))
+			level = CPU_AVX2;
+		else if (__builtin_cpu_supports("ssse3"))
+			level = CPU_SSSE3;
+		else
+			level = CPU_SCALAR;
+	}
+	return level;
+}
+
+#endif
+
+void pixel_convert_row_rgb(const unsigned char *src, uint32_t *dst, int width,
+	int n_channels) {
+	int x = 0;
+	
+#ifdef PIXEL_CONVERT_X86
+	switch (cpu_level()) {
+	case CPU_AVX2:
+		x = convert_row_rgb_avx2(src, dst, width, n_channels);
+		break;
+	case CPU_SSSE3:
+		x = convert_row_rgb_ssse3(src, dst, width, n_channels);
+		break;
+	}
+#endif
+	convert_row_rgb_scalar(src + x * n_channels, dst + x, width - x,
+		n_channels);
+}
+
+void pixel_convert_row_gray(const unsigned char *src, uint32_t *dst,
+	int width, int n_channels) {
+	int x = 0;
+	
+#ifdef PIXEL_CONVERT_X86
+	switch (cpu_level()) {
+	case CPU_AVX2:
+		x = convert_row_gray_avx2(src, dst, width, n_channels);
+		break;
+	case CPU_SSSE3:
+		x = convert_row_gray_ssse3(src, dst, width, n_channels);
+		break;
+	}
+#endif
+	/* The vector loops convert multiples of 4 pixels, so x is at the start of
+		a word */
+	convert_row_gray_scalar(src + x * n_channels, dst + x / 4, width - x,
+		n_channels);
+}
+
+void pixel_convert_row_xrgb(const uint32_t *src, unsigned char *dst,
+	int width) {
+	int x = 0;
+	
+#ifdef PIXEL_CONVERT_X86
+	if (cpu_level() >= CPU_SSSE3)
+		x = convert_row_xrgb_ssse3(src, dst, width);
+#endif
+	convert_row_xrgb_scalar(src + x, dst + 3 * x, width - x);
+}
+
+uint64_t pixel_convert_row_difference(const unsigned char *a,
+	const unsigned char *b, int length) {
+	uint64_t sum = 0;
+	int i = 0;
+	
+#ifdef PIXEL_CONVERT_X86
+	/* Every processor with SSSE3 has SSE2 */
+	switch (cpu_level()) {
+	case CPU_AVX2:
+		i = row_difference_avx2(a, b, length, &sum);
+		break;
+	case CPU_SSSE3:
+		i = row_difference_sse2(a, b, length, &sum);
+		break;
+	}
+#endif
+	return sum + row_difference_scalar(a + i, b + i, length - i);
+}
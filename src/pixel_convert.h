@@ -0,0 +1,48 @@
+/*
+ * Copyright 2017 sprin0
+ * 
+ * This file is part of JpnCap.
+ * 
+ * JpnCap is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * JpnCap is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with JpnCap.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+/** Converts width pixels of 8 bit RGB (n_channels 3) or RGBA (n_channels 4) at
+	src to a row of a 32 bpp Leptonica image at dst. The alpha channel is
+	ignored.
+*/
+void pixel_convert_row_rgb(const unsigned char *src, uint32_t *dst, int width,
+	int n_channels);
+
+/** Converts width pixels of 8 bit RGB (n_channels 3) or RGBA (n_channels 4) at
+	src to a row of a 8 bpp grayscale Leptonica image at dst. The alpha channel
+	is ignored.
+*/
+void pixel_convert_row_gray(const unsigned char *src, uint32_t *dst,
+	int width, int n_channels);
+
+/** Converts width 32 bit pixels 0xXXRRGGBB at src, e.g. a row of an X image
+	in the byte order of this machine, to width pixels of 8 bit RGB at dst.
+*/
+void pixel_convert_row_xrgb(const uint32_t *src, unsigned char *dst,
+	int width);
+
+/** Returns the sum of the absolute differences between the length bytes at a
+	and those at b, e.g. of two rows of pixels.
+*/
+uint64_t pixel_convert_row_difference(const unsigned char *a,
+	const unsigned char *b, int length);
@@ -20,44 +20,80 @@
 #include <leptonica/allheaders.h>
 #include <tesseract/capi.h>
 #include <ctype.h>
+#include <limits.h>
+#include <string.h>
+#include <math.h>
 
 #include "recognize.h"
+#include "pixel_convert.h"
+#include "hashmap.h"
 #include "string_util.h"
 
 #define DEFAULT_DPI_STR "70"
+/* Glyphs scaled to the target height are about as large as text scanned at
+	this resolution */
+#define PREPROCESS_DPI 300
+/* Connected components smaller than this are not considered glyphs */
+#define GLYPH_SIZE_MIN 4
+/* Glyph size estimations closer than this to the target are not scaled */
+#define SCALE_TOLERANCE 0.15
+#define SCALE_MIN 0.25
+#define SCALE_MAX 4.0
+#define SAUVOLA_FACTOR 0.34
+/* Components larger than this many glyphs are not text */
+#define GLYPH_SIZE_RATIO_MAX 2
+/* Groups of glyphs with fewer than the largest group divided by this are
+	taken for artwork when cropping */
+#define TEXT_GROUP_RATIO 4
+#define TEXT_GLYPHS_MIN 2
+/* Text regions larger than this part of the capture are not cropped */
+#define CROP_AREA_MAX 0.9
+/* Captures with fewer pixels are recognized in one piece */
+#define BLOCKS_AREA_MIN (400 * 400)
+/* The gaps between lines have to be this much wider than those between the
+	glyphs of a line to guess the orientation from them */
+#define LINE_GAP_RATIO 1.5
 
-
-static PIX *pixbuf_to_leptpix(GdkPixbuf *pixbuf) {
+/** Converts the part rect of pixbuf, or all of it if rect is NULL, to a
+	Leptonica image. If gray is set, the image has 8 bpp grayscale pixels,
+	otherwise 32 bpp RGB pixels. An alpha channel is ignored.
+*/
+static PIX *pixbuf_to_leptpix(GdkPixbuf *pixbuf, const GdkRectangle *rect,
+	int gray) {
 	PIX *output;
-	int width, height, rowstride;
-	guchar *pixels;
-	int x, y;
+	GdkRectangle area = {0, 0, 0, 0};
+	int rowstride, n_channels, wpl;
+	const guchar *pixels;
+	l_uint32 *data;
+	int y;
 	const char *xdpi, *ydpi;
-	union {
-		guchar chars[4];
-		l_uint32 int_pix;
-	} pixel;
 
-	if (gdk_pixbuf_get_has_alpha(pixbuf) ||
-	        gdk_pixbuf_get_colorspace(pixbuf) != GDK_COLORSPACE_RGB ||
+	n_channels = gdk_pixbuf_get_n_channels(pixbuf);
+	if (gdk_pixbuf_get_colorspace(pixbuf) != GDK_COLORSPACE_RGB ||
 	        gdk_pixbuf_get_bits_per_sample(pixbuf) != 8 ||
-	        gdk_pixbuf_get_n_channels(pixbuf) != 3)
+	        n_channels != (gdk_pixbuf_get_has_alpha(pixbuf) ? 4 : 3))
 		return NULL;
 
-	width = gdk_pixbuf_get_width(pixbuf);
-	height = gdk_pixbuf_get_height(pixbuf);
+	area.width = gdk_pixbuf_get_width(pixbuf);
+	area.height = gdk_pixbuf_get_height(pixbuf);
+	if (rect != NULL && !gdk_rectangle_intersect(rect, &area, &area))
+		return NULL;
 	rowstride = gdk_pixbuf_get_rowstride(pixbuf);
-	output = pixCreateNoInit(width, height, 32);
-
-	pixels = gdk_pixbuf_get_pixels(pixbuf);
-	for (y = 0; y < height; y++) {
-		for (x = 0; x < width; x++) {
-			memset(pixel.chars, 0, sizeof(pixel.chars));
-			pixel.chars[3] = *(pixels + y * rowstride + x * 3 + 0);
-			pixel.chars[2] = *(pixels + y * rowstride + x * 3 + 1);
-			pixel.chars[1] = *(pixels + y * rowstride + x * 3 + 2);
-			output->data[y * width + x] = pixel.int_pix;
-		}
+	output = pixCreateNoInit(area.width, area.height, gray ? 8 : 32);
+	data = pixGetData(output);
+	wpl = pixGetWpl(output);
+
+	/* Only the pixels inside area are read, so there is no need to crop
+		pixbuf first */
+	pixels = gdk_pixbuf_get_pixels(pixbuf) + area.y * rowstride
+		+ area.x * n_channels;
+	for (y = 0; y < area.height; y++) {
+		if (gray)
+			pixel_convert_row_gray(pixels + y * rowstride, data + y * wpl,
+				area.width, n_channels);
+		else
+			pixel_convert_row_rgb(pixels + y * rowstride, data + y * wpl,
+				area.width, n_channels);
 	}
 	
 	xdpi = gdk_pixbuf_get_option(pixbuf, "x-dpi");
@@ -71,12 +107,533 @@ static PIX *pixbuf_to_leptpix(GdkPixbuf *pixbuf) {
 	return output;
 }
 
-static char *TesseractRecogize(PIX *img, TessBaseAPI *tess_handle) {
+void recognize_fingerprint(GdkPixbuf *pixbuf, const GdkRectangle *rect,
+	recognize_Fingerprint *fingerprint) {
+	GdkRectangle area = {0, 0, 0, 0};
+	uint64_t hash = 14695981039346656037ULL;
+	uint32_t *row;
+	const guchar *pixels;
+	int rowstride, n_channels, words, x, y;
+	
+	memset(fingerprint, 0, sizeof(*fingerprint));
+	n_channels = gdk_pixbuf_get_n_channels(pixbuf);
+	if (gdk_pixbuf_get_colorspace(pixbuf) != GDK_COLORSPACE_RGB ||
+	        gdk_pixbuf_get_bits_per_sample(pixbuf) != 8 ||
+	        n_channels != (gdk_pixbuf_get_has_alpha(pixbuf) ? 4 : 3))
+		return;
+	area.width = gdk_pixbuf_get_width(pixbuf);
+	area.height = gdk_pixbuf_get_height(pixbuf);
+	if (rect != NULL && !gdk_rectangle_intersect(rect, &area, &area))
+		return;
+	
+	rowstride = gdk_pixbuf_get_rowstride(pixbuf);
+	pixels = gdk_pixbuf_get_pixels(pixbuf) + area.y * rowstride
+		+ area.x * n_channels;
+	/* The rows are converted like for recognition, which also packs the
+		bytes so that they can be hashed a word at a time */
+	words = (area.width + 3) / 4;
+	row = malloc(words * sizeof(uint32_t));
+	for (y = 0; y < area.height; y++) {
+		pixel_convert_row_gray(pixels + y * rowstride, row, area.width,
+			n_channels);
+		for (x = 0; x < words; x++)
+			hash = (hash ^ row[x]) * 1099511628211ULL;
+	}
+	free(row);
+	
+	fingerprint->exact = hash;
+	fingerprint->width = area.width;
+	fingerprint->height = area.height;
+}
+
+/** Returns the typical size of the glyphs in the binary image pix with
+	black text on white or 0 if there are too few glyphs to tell. Parts of
+	glyphs are components of their own, so the larger ones are taken.
+*/
+static int estimate_glyph_size(PIX *pix) {
+	BOXA *boxes;
+	NUMA *sizes;
+	l_int32 i, n, w, h, pix_w, pix_h;
+	l_float32 size = 0;
+	
+	if ((boxes = pixConnCompBB(pix, 8)) == NULL)
+		return 0;
+	pix_w = pixGetWidth(pix);
+	pix_h = pixGetHeight(pix);
+	n = boxaGetCount(boxes);
+	sizes = numaCreate(n);
+	for (i = 0; i < n; i++) {
+		boxaGetBoxGeometry(boxes, i, NULL, NULL, &w, &h);
+		/* Leave out specks, lines and frames */
+		if (MAX(w, h) < GLYPH_SIZE_MIN || w > 4 * h || h > 4 * w
+			|| (w > pix_w * 9 / 10 && h > pix_h * 9 / 10))
+			continue;
+		numaAddNumber(sizes, MAX(w, h));
+	}
+	if (numaGetCount(sizes) >= 3)
+		numaGetRankValue(sizes, 0.75, NULL, 0, &size);
+	
+	numaDestroy(&sizes);
+	boxaDestroy(&boxes);
+	return size;
+}
+
+/** Binarizes the 8 bpp image pix with method. Returns NULL on failure.
+*/
+static PIX *binarize(PIX *pix, binarize_method method, int glyph_height) {
+	PIX *output = NULL;
+	l_int32 w, h, half_window, tile;
+	
+	w = pixGetWidth(pix);
+	h = pixGetHeight(pix);
+	/* The Sauvola window should hold a glyph but must fit into the image */
+	half_window = MIN(glyph_height, (MIN(w, h) - 3) / 2);
+	if (method == BINARIZE_SAUVOLA && half_window >= 2) {
+		if (pixSauvolaBinarizeTiled(pix, half_window, SAUVOLA_FACTOR, 1, 1,
+			NULL, &output) == 0)
+			return output;
+	}
+	tile = MAX(16, 4 * glyph_height);
+	if (pixOtsuAdaptiveThreshold(pix, tile, tile, 0, 0, 0.1, NULL, &output)
+		!= 0)
+		return NULL;
+	return output;
+}
+
+/** Returns whether more than half of the pixels of the binary image pix are
+	black, which means it has light text on a dark background.
+*/
+static int is_dark(PIX *pix) {
+	l_int32 count;
+	
+	if (pixCountPixels(pix, &count, NULL) != 0)
+		return 0;
+	return count > pixGetWidth(pix) * pixGetHeight(pix) / 2;
+}
+
+/** Returns the part of the binary image pix with black text on white that
+	holds its text, or NULL if that is about all of pix or cannot be told.
+	Components up to a few glyphs large are grouped like the blocks of
+	recognize_find_blocks, which leaves a margin of half a glyph. Groups with
+	few glyphs compared to the largest one are taken for artwork, like the
+	art around a speech balloon, as are larger components.
+*/
+static BOX *find_text_region(PIX *pix, int glyph_size) {
+	PIX *glyphs, *dilated;
+	BOXA *glyph_boxes = NULL, *groups = NULL;
+	BOX *region = NULL;
+	l_int32 i, j, n, m, x, y, w, h, gx, gy, gw, gh, count_min;
+	l_int32 left = INT_MAX, top = INT_MAX, right = 0, bottom = 0;
+	int *counts, count_max = 0;
+	
+	if ((glyphs = pixSelectBySize(pix, GLYPH_SIZE_RATIO_MAX * glyph_size,
+		GLYPH_SIZE_RATIO_MAX * glyph_size, 8, L_SELECT_IF_BOTH,
+		L_SELECT_IF_LTE, NULL)) == NULL)
+		return NULL;
+	if ((dilated = pixDilateBrick(NULL, glyphs, glyph_size, glyph_size))
+		!= NULL) {
+		glyph_boxes = pixConnCompBB(glyphs, 8);
+		groups = pixConnCompBB(dilated, 8);
+		pixDestroy(&dilated);
+	}
+	pixDestroy(&glyphs);
+	if (glyph_boxes == NULL || groups == NULL) {
+		boxaDestroy(&glyph_boxes);
+		boxaDestroy(&groups);
+		return NULL;
+	}
+	
+	/* Every glyph belongs to the group its center lies in */
+	n = boxaGetCount(groups);
+	m = boxaGetCount(glyph_boxes);
+	counts = calloc(MAX(n, 1), sizeof(int));
+	for (j = 0; j < m; j++) {
+		boxaGetBoxGeometry(glyph_boxes, j, &x, &y, &w, &h);
+		if (MAX(w, h) < GLYPH_SIZE_MIN)
+			continue;
+		x += w / 2;
+		y += h / 2;
+		for (i = 0; i < n; i++) {
+			boxaGetBoxGeometry(groups, i, &gx, &gy, &gw, &gh);
+			if (x >= gx && x < gx + gw && y >= gy && y < gy + gh) {
+				count_max = MAX(count_max, ++counts[i]);
+				break;
+			}
+		}
+	}
+	
+	count_min = MAX(TEXT_GLYPHS_MIN, count_max / TEXT_GROUP_RATIO);
+	for (i = 0; i < n; i++) {
+		if (counts[i] < count_min)
+			continue;
+		boxaGetBoxGeometry(groups, i, &gx, &gy, &gw, &gh);
+		left = MIN(left, gx);
+		top = MIN(top, gy);
+		right = MAX(right, gx + gw);
+		bottom = MAX(bottom, gy + gh);
+	}
+	free(counts);
+	boxaDestroy(&glyph_boxes);
+	boxaDestroy(&groups);
+	
+	if (right > left && (double)(right - left) * (bottom - top)
+		< CROP_AREA_MAX * pixGetWidth(pix) * pixGetHeight(pix))
+		region = boxCreate(left, top, right - left, bottom - top);
+	return region;
+}
+
+/** Prepares the 8 bpp image pix for recognition as described by settings.
+	Returns a new image or NULL on failure.
+*/
+static PIX *preprocess_image(PIX *pix, const recognize_Preprocess *settings,
+	recognize_Timing *timing) {
+	PIX *gray, *binary, *cropped, *scaled, *output;
+	BOX *region;
+	l_float32 scale = 1;
+	int glyph_size;
+	gint64 start;
+	
+	/* Find out the text color and glyph size from a plain Otsu threshold */
+	start = g_get_monotonic_time();
+	if (pixOtsuAdaptiveThreshold(pix, MAX(16, pixGetWidth(pix)),
+		MAX(16, pixGetHeight(pix)), 0, 0, 0.1, NULL, &binary) != 0)
+		return NULL;
+	if (is_dark(binary)) {
+		gray = pixInvert(NULL, pix);
+		pixInvert(binary, binary);
+	} else
+		gray = pixClone(pix);
+	glyph_size = estimate_glyph_size(binary);
+	timing->analyze = g_get_monotonic_time() - start;
+	
+	/* Only the text is passed on, so that Tesseract spends no time on the
+		artwork around it */
+	start = g_get_monotonic_time();
+	if (settings->crop && glyph_size > 0
+		&& (region = find_text_region(binary, glyph_size)) != NULL) {
+		
+		if ((cropped = pixClipRectangle(gray, region, NULL)) != NULL) {
+			g_debug("preprocess_image: cropped %dx%d to %dx%d pixels",
+				pixGetWidth(gray), pixGetHeight(gray), pixGetWidth(cropped),
+				pixGetHeight(cropped));
+			pixDestroy(&gray);
+			gray = cropped;
+		}
+		boxDestroy(&region);
+	}
+	pixDestroy(&binary);
+	timing->crop = g_get_monotonic_time() - start;
+	
+	start = g_get_monotonic_time();
+	if (glyph_size > 0) {
+		scale = (l_float32)settings->glyph_height / glyph_size;
+		scale = MAX(SCALE_MIN, MIN(SCALE_MAX, scale));
+	}
+	if (fabsf(scale - 1) > SCALE_TOLERANCE) {
+		scaled = pixScale(gray, scale, scale);
+		pixDestroy(&gray);
+		if (scaled == NULL)
+			return NULL;
+	} else
+		scaled = gray;
+	timing->scale = g_get_monotonic_time() - start;
+	
+	start = g_get_monotonic_time();
+	if (settings->binarize == BINARIZE_NONE)
+		output = scaled;
+	else {
+		output = binarize(scaled, settings->binarize, settings->glyph_height);
+		pixDestroy(&scaled);
+		if (output == NULL)
+			return NULL;
+		/* A dark background can be left if the text was hard to separate
+			before the binarization */
+		if (is_dark(output))
+			pixInvert(output, output);
+	}
+	timing->binarize = g_get_monotonic_time() - start;
+	
+	pixSetResolution(output, PREPROCESS_DPI, PREPROCESS_DPI);
+	return output;
+}
+
+/** Joins overlapping rectangles of blocks until none overlap anymore.
+*/
+static void merge_overlapping(Rectangle_vector *blocks) {
+	size_t i, j;
+	int merged = 1;
+	
+	while (merged) {
+		merged = 0;
+		for (i = 0; i < blocks->length; i++) {
+			for (j = i + 1; j < blocks->length; j++) {
+				if (!gdk_rectangle_intersect(blocks->data + i,
+					blocks->data + j, NULL))
+					continue;
+				gdk_rectangle_union(blocks->data + i, blocks->data + j,
+					blocks->data + i);
+				rectangle_vector_remove(blocks, j);
+				merged = 1;
+				/* Check the grown block against all others again */
+				j = i;
+			}
+		}
+	}
+}
+
+typedef struct {
+	GdkRectangle rect;
+	/* The span of the block across the columns or rows and its position
+		along them */
+	int across;
+	int across_end;
+	int along;
+	/* The column or row of the block, counted in reading order */
+	int group;
+} Ordered_block;
+
+static int compare_across(const void *pa, const void *pb) {
+	const Ordered_block *a = pa, *b = pb;
+	
+	if (a->across != b->across)
+		return a->across - b->across;
+	return a->along - b->along;
+}
+
+static int compare_reading(const void *pa, const void *pb) {
+	const Ordered_block *a = pa, *b = pb;
+	
+	if (a->group != b->group)
+		return a->group - b->group;
+	if (a->along != b->along)
+		return a->along - b->along;
+	return a->across - b->across;
+}
+
+/** Sorts blocks in reading order. Blocks whose spans across the text
+	overlap, even through other blocks, form a column or row. Vertical
+	columns are read from right to left, the blocks of a column from top to
+	bottom. Horizontal rows are read from top to bottom, the blocks of a row
+	from left to right.
+*/
+static void sort_reading_order(Rectangle_vector *blocks, int vertical) {
+	Ordered_block *ordered;
+	size_t i, n = blocks->length;
+	int group = 0, group_end = 0;
+	
+	ordered = malloc(n * sizeof(*ordered));
+	for (i = 0; i < n; i++) {
+		ordered[i].rect = blocks->data[i];
+		ordered[i].across = vertical ? blocks->data[i].x : blocks->data[i].y;
+		ordered[i].across_end = ordered[i].across
+			+ (vertical ? blocks->data[i].width : blocks->data[i].height);
+		ordered[i].along = vertical ? blocks->data[i].y : blocks->data[i].x;
+	}
+	/* Sweeping the spans from their start joins the overlapping ones */
+	qsort(ordered, n, sizeof(*ordered), compare_across);
+	for (i = 0; i < n; i++) {
+		if (i == 0 || ordered[i].across >= group_end) {
+			group++;
+			group_end = ordered[i].across_end;
+		} else
+			group_end = MAX(group_end, ordered[i].across_end);
+		ordered[i].group = vertical ? -group : group;
+	}
+	qsort(ordered, n, sizeof(*ordered), compare_reading);
+	for (i = 0; i < n; i++)
+		blocks->data[i] = ordered[i].rect;
+	free(ordered);
+}
+
+Rectangle_vector *recognize_find_blocks(GdkPixbuf *pixbuf,
+	const GdkRectangle *rect, text_ori orientation) {
+	PIX *gray, *binary, *dilated;
+	BOXA *boxes;
+	Rectangle_vector *blocks = NULL;
+	GdkRectangle area, block;
+	l_int32 i, n, glyph_size;
+	size_t j, tall = 0;
+	
+	area.x = 0;
+	area.y = 0;
+	area.width = gdk_pixbuf_get_width(pixbuf);
+	area.height = gdk_pixbuf_get_height(pixbuf);
+	if (rect != NULL && !gdk_rectangle_intersect(rect, &area, &area))
+		return NULL;
+	if (area.width * area.height < BLOCKS_AREA_MIN)
+		return NULL;
+	
+	if ((gray = pixbuf_to_leptpix(pixbuf, &area, 1)) == NULL)
+		return NULL;
+	if (pixOtsuAdaptiveThreshold(gray, area.width, area.height, 0, 0, 0.1,
+		NULL, &binary) != 0) {
+		pixDestroy(&gray);
+		return NULL;
+	}
+	pixDestroy(&gray);
+	if (is_dark(binary))
+		pixInvert(binary, binary);
+	if ((glyph_size = estimate_glyph_size(binary)) == 0) {
+		pixDestroy(&binary);
+		return NULL;
+	}
+	
+	/* Glyphs, lines and columns of a block are closer to each other than the
+		size of a glyph, while blocks are further apart. The blocks grow by
+		half a glyph on every side, which is kept as margin. */
+	dilated = pixDilateBrick(NULL, binary, glyph_size, glyph_size);
+	pixDestroy(&binary);
+	if (dilated == NULL)
+		return NULL;
+	boxes = pixConnCompBB(dilated, 8);
+	pixDestroy(&dilated);
+	if (boxes == NULL)
+		return NULL;
+	
+	blocks = rectangle_vector_create();
+	n = boxaGetCount(boxes);
+	for (i = 0; i < n; i++) {
+		boxaGetBoxGeometry(boxes, i, &block.x, &block.y, &block.width,
+			&block.height);
+		/* Leave out specks */
+		if (block.width < glyph_size * 3 / 2
+			&& block.height < glyph_size * 3 / 2)
+			continue;
+		block.x += area.x;
+		block.y += area.y;
+		rectangle_vector_append(blocks, block);
+	}
+	boxaDestroy(&boxes);
+	merge_overlapping(blocks);
+	if (blocks->length < 2) {
+		rectangle_vector_destroy(blocks);
+		return NULL;
+	}
+	
+	if (orientation == TEXT_ORIENTATION_AUTO) {
+		for (j = 0; j < blocks->length; j++)
+			tall += blocks->data[j].height > blocks->data[j].width;
+		orientation = 2 * tall > blocks->length ? TEXT_ORIENTATION_VERTICAL
+			: TEXT_ORIENTATION_HORIZONTAL;
+	}
+	sort_reading_order(blocks, orientation == TEXT_ORIENTATION_VERTICAL);
+	return blocks;
+}
+
+/** Returns the mean width of the runs of empty rows or columns in the
+	projection profile, only counting those between the first and last
+	non-empty one. Returns 0 if there are none.
+*/
+static double mean_gap(NUMA *profile) {
+	l_int32 i, n, value, first = -1, last = -1;
+	int gaps = 0, gap_width = 0, in_gap = 0;
+	
+	n = numaGetCount(profile);
+	for (i = 0; i < n; i++) {
+		numaGetIValue(profile, i, &value);
+		if (value == 0)
+			continue;
+		if (first < 0)
+			first = i;
+		last = i;
+	}
+	for (i = first + 1; first >= 0 && i < last; i++) {
+		numaGetIValue(profile, i, &value);
+		if (value == 0) {
+			gaps += !in_gap;
+			gap_width++;
+		}
+		in_gap = value == 0;
+	}
+	return gaps == 0 ? 0 : (double)gap_width / gaps;
+}
+
+text_ori recognize_guess_orientation(GdkPixbuf *pixbuf,
+	const GdkRectangle *rect) {
+	PIX *gray, *binary;
+	NUMA *rows, *columns;
+	double row_gap, column_gap;
+	text_ori orientation = TEXT_ORIENTATION_AUTO;
+	
+	if ((gray = pixbuf_to_leptpix(pixbuf, rect, 1)) == NULL)
+		return orientation;
+	if (pixOtsuAdaptiveThreshold(gray, pixGetWidth(gray),
+		pixGetHeight(gray), 0, 0, 0.1, NULL, &binary) != 0) {
+		pixDestroy(&gray);
+		return orientation;
+	}
+	pixDestroy(&gray);
+	if (is_dark(binary))
+		pixInvert(binary, binary);
+	
+	rows = pixCountPixelsByRow(binary, NULL);
+	columns = pixCountPixelsByColumn(binary);
+	pixDestroy(&binary);
+	if (rows == NULL || columns == NULL) {
+		numaDestroy(&rows);
+		numaDestroy(&columns);
+		return orientation;
+	}
+	/* Japanese glyphs stand in a grid, so both profiles have gaps. The ones
+		between lines or columns are wider than those between glyphs. A single
+		line has no gaps across it and is left to the full comparison. */
+	row_gap = mean_gap(rows);
+	column_gap = mean_gap(columns);
+	if (row_gap > 0 && column_gap > 0) {
+		if (row_gap > LINE_GAP_RATIO * column_gap)
+			orientation = TEXT_ORIENTATION_HORIZONTAL;
+		else if (column_gap > LINE_GAP_RATIO * row_gap)
+			orientation = TEXT_ORIENTATION_VERTICAL;
+	}
+	numaDestroy(&rows);
+	numaDestroy(&columns);
+	return orientation;
+}
+
+static BOOL monitor_cancel(void *cancel_this, int words) {
+	const recognize_Control *control = (const recognize_Control*)cancel_this;
+	
+	return control->cancelled != NULL && control->cancelled(control->data);
+}
+
+static BOOL monitor_progress(ETEXT_DESC *monitor, int left, int right,
+	int top, int bottom) {
+	const recognize_Control *control =
+		(const recognize_Control*)TessMonitorGetCancelThis(monitor);
+	
+	if (control->progress != NULL)
+		control->progress(TessMonitorGetProgress(monitor), control->data);
+	return FALSE;
+}
+
+static char *TesseractRecogize(PIX *img, TessBaseAPI *tess_handle,
+	const recognize_Control *control, int *confidence) {
+	ETEXT_DESC *monitor = NULL;
 	char *text;
+	int status;
 
+	if (control != NULL) {
+		if (monitor_cancel((void*)control, 0))
+			return NULL;
+		monitor = TessMonitorCreate();
+		TessMonitorSetCancelFunc(monitor, monitor_cancel);
+		TessMonitorSetCancelThis(monitor, (void*)control);
+		TessMonitorSetProgressFunc(monitor, monitor_progress);
+		/* The deadline counts from here */
+		if (control->deadline > 0)
+			TessMonitorSetDeadlineMSecs(monitor, control->deadline);
+	}
 	TessBaseAPISetImage2(tess_handle, img);
-	if (TessBaseAPIRecognize(tess_handle, NULL) != 0) {
-		fprintf(stderr, "Could not tesseract recognize\n");
+	status = TessBaseAPIRecognize(tess_handle, monitor);
+	if (monitor != NULL)
+		TessMonitorDelete(monitor);
+	if (status != 0) {
+		/* Stopping on request is no error */
+		if (control == NULL || !monitor_cancel((void*)control, 0))
+			fprintf(stderr, "Could not tesseract recognize%s\n",
+				control != NULL && control->deadline > 0
+				? ", maybe it took longer than the deadline" : "");
+		TessBaseAPIClear(tess_handle);
 		return NULL;
 	}
 
@@ -84,75 +641,254 @@ static char *TesseractRecogize(PIX *img, TessBaseAPI *tess_handle) {
 		fprintf(stderr, "Could not get tesseract text\n");
 		return NULL;
 	}
+	if (confidence != NULL)
+		*confidence = TessBaseAPIMeanTextConf(tess_handle);
 
 	TessBaseAPIClear(tess_handle);
 	return text;
 }
 
-Vector *substitutions_load(const char *file_name) {
+/* States of the substitution automaton are numbered from the root 0 on.
+	Transitions from the root are kept in a table, all others in a hash map
+	keyed by the state and the byte, as most states have a single one. */
+
+typedef struct {
+	/* The state of the longest proper suffix that is a prefix of a rule */
+	uint32_t fail;
+	uint32_t depth;
+	/* The rule whose from ends here or -1 */
+	int32_t rule;
+	/* The rule with the longest from that is a suffix of this state or -1 */
+	int32_t match;
+} Automaton_state;
+
+typedef struct {
+	uint32_t from;
+	uint32_t to;
+	unsigned char byte;
+} Automaton_edge;
+
+VECTOR_DEFINE(Automaton_state_vector, automaton_state_vector, Automaton_state)
+VECTOR_DEFINE(Automaton_edge_vector, automaton_edge_vector, Automaton_edge)
+HASHMAP_DEFINE(Transition_map, transition_map, uint64_t, uint32_t,
+	hashmap_hash_int, HASHMAP_EQUALS_INT)
+
+struct Substitution_automaton {
+	Automaton_state_vector *states;
+	uint32_t root[256];
+	Transition_map *transitions;
+	/* The most bytes a rule puts in for each byte it takes out */
+	size_t growth;
+};
+
+static uint64_t transition_key(uint32_t state, unsigned char byte) {
+	return (uint64_t)state << 8 | byte;
+}
+
+/** Returns the state reached from the prefix state by byte in the trie of the
+	rules or 0 if there is none.
+*/
+static uint32_t automaton_child(const struct Substitution_automaton *automaton,
+	uint32_t state, unsigned char byte) {
+	uint32_t *to;
+	
+	if (state == 0)
+		return automaton->root[byte];
+	to = transition_map_get(automaton->transitions,
+		transition_key(state, byte));
+	return to == NULL ? 0 : *to;
+}
+
+/** Returns the state after reading byte in state.
+*/
+static uint32_t automaton_step(const struct Substitution_automaton *automaton,
+	uint32_t state, unsigned char byte) {
+	uint32_t next;
+	
+	while (state != 0 && (next = automaton_child(automaton, state, byte))
+		== 0)
+		state = automaton->states->data[state].fail;
+	return state == 0 ? automaton->root[byte] : next;
+}
+
+static struct Substitution_automaton *automaton_create(
+	const Substitution_vector *rules) {
+	struct Substitution_automaton *automaton;
+	Automaton_edge_vector *edges, *by_depth;
+	Automaton_state state = {0, 0, -1, -1}, *to;
+	const Automaton_edge *edge;
+	const unsigned char *c;
+	uint32_t current, next, max_depth = 0, depth;
+	size_t i, from_len, to_len;
+	
+	automaton = malloc(sizeof(*automaton));
+	automaton->states = automaton_state_vector_create();
+	automaton->transitions = transition_map_create();
+	memset(automaton->root, 0, sizeof(automaton->root));
+	automaton->growth = 1;
+	automaton_state_vector_append(automaton->states, state);
+	edges = automaton_edge_vector_create();
+	
+	/* Build the trie of the froms */
+	for (i = 0; i < rules->length; i++) {
+		current = 0;
+		for (c = (const unsigned char*)rules->data[i].from; *c; c++) {
+			if ((next = automaton_child(automaton, current, *c)) == 0) {
+				next = automaton->states->length;
+				state.depth = automaton->states->data[current].depth + 1;
+				max_depth = MAX(max_depth, state.depth);
+				automaton_state_vector_append(automaton->states, state);
+				if (current == 0)
+					automaton->root[*c] = next;
+				else
+					transition_map_set(automaton->transitions,
+						transition_key(current, *c), next);
+				automaton_edge_vector_append(edges,
+					(Automaton_edge){current, next, *c});
+			}
+			current = next;
+		}
+		/* The first rule for a from is kept */
+		if (automaton->states->data[current].rule < 0)
+			automaton->states->data[current].rule = i;
+		
+		from_len = strlen(rules->data[i].from);
+		to_len = strlen(rules->data[i].to);
+		automaton->growth = MAX(automaton->growth,
+			(to_len + from_len - 1) / from_len);
+	}
+	
+	/* Failure links point to shallower states, so they are set in the order
+		of depth */
+	by_depth = automaton_edge_vector_create();
+	automaton_edge_vector_reserve(by_depth, edges->length);
+	for (depth = 1; depth <= max_depth; depth++) {
+		for (i = 0; i < edges->length; i++) {
+			edge = edges->data + i;
+			if (automaton->states->data[edge->to].depth == depth)
+				automaton_edge_vector_append(by_depth, *edge);
+		}
+	}
+	for (i = 0; i < by_depth->length; i++) {
+		edge = by_depth->data + i;
+		to = automaton->states->data + edge->to;
+		to->fail = edge->from == 0 ? 0 : automaton_step(automaton,
+			automaton->states->data[edge->from].fail, edge->byte);
+		to->match = to->rule >= 0 ? to->rule
+			: automaton->states->data[to->fail].match;
+	}
+	automaton_edge_vector_destroy(by_depth);
+	automaton_edge_vector_destroy(edges);
+	return automaton;
+}
+
+static void automaton_destroy(struct Substitution_automaton *automaton) {
+	automaton_state_vector_destroy(automaton->states);
+	transition_map_destroy(automaton->transitions);
+	free(automaton);
+}
+
+Substitutions *substitutions_load(const char *file_name) {
 	FILE *subs_file;
-	Vector *subs;
+	Substitutions *subs;
 	Substitution sub;
 	char *line = NULL, *sub_pos = NULL;
 	size_t len = 0;
 	
-	subs = vector_create(sizeof(sub));
-	if ((subs_file = fopen(file_name, "r")) == NULL)
-		return subs; /* Return empty substitutions */
-	
-	while (getline(&line, &len, subs_file) != -1) {
-		size_t line_len = strlen(line);
-		if (line_len > 1 && line[line_len - 1] == '\n')
-			line[--line_len] = '\0';
-		if (line_len > 1 && line[line_len - 1] == '\r')
-			line[--line_len] = '\0';
-		
-		if ((sub_pos = strchr(line, '=')) == NULL)
-			continue;
-		if (line == sub_pos)
-			continue;
+	subs = malloc(sizeof(*subs));
+	subs->rules = substitution_vector_create();
+	if ((subs_file = fopen(file_name, "r")) != NULL) {
+		while (getline(&line, &len, subs_file) != -1) {
+			size_t line_len = strlen(line);
+			if (line_len > 1 && line[line_len - 1] == '\n')
+				line[--line_len] = '\0';
+			if (line_len > 1 && line[line_len - 1] == '\r')
+				line[--line_len] = '\0';
+			
+			if ((sub_pos = strchr(line, '=')) == NULL)
+				continue;
+			if (line == sub_pos)
+				continue;
 
-		*(sub_pos++) = '\0';
-		sub.from = strdup(line);
-		sub.to = strdup(sub_pos);
-		
-		vector_append(subs, &sub);
+			*(sub_pos++) = '\0';
+			sub.from = strdup(line);
+			sub.to = strdup(sub_pos);
+			
+			substitution_vector_append(subs->rules, sub);
+		}
+		free(line);
+		fclose(subs_file);
 	}
-	free(line);
-	fclose(subs_file);
 	
+	subs->automaton = automaton_create(subs->rules);
 	return subs;
 }
 
-char *substitutions_apply(Vector *subs, const char *text) {
-	char *output, *input;
-	size_t pos = 0;
+char *substitutions_apply(const Substitutions *subs, const char *text) {
+	const struct Substitution_automaton *automaton = subs->automaton;
+	const Automaton_state *states = automaton->states->data;
 	const Substitution *sub;
+	const unsigned char *input = (const unsigned char*)text;
+	char *output, *out_p;
+	size_t len = strlen(text), pos = 0, copied = 0;
+	size_t match_start = 0, match_len = 0, start;
+	uint32_t state = 0;
+	int32_t match_rule = -1, rule;
 	
-	input = output = strdup(text);
-	while ((sub = vector_get_const(subs, pos++))) {
-		if (string_count_string(input, sub->from) == 0)
-			continue;
-		output = string_replace_string(input, sub->from, sub->to);
-		free(input);
-		input = output;
+	/* No rule puts in more than growth bytes per byte, so the output fits */
+	output = out_p = malloc(len * automaton->growth + 1);
+	for (;;) {
+		if (pos < len) {
+			state = automaton_step(automaton, state, input[pos++]);
+			if ((rule = states[state].match) >= 0) {
+				/* The longest match ending here starts leftmost */
+				start = pos - strlen(subs->rules->data[rule].from);
+				if (match_rule < 0 || start < match_start
+					|| (start == match_start
+					&& pos - start > match_len)) {
+					match_rule = rule;
+					match_start = start;
+					match_len = pos - start;
+				}
+			}
+			/* A match starting at or before match_start can still come
+				as long as the current state reaches back that far */
+			if (match_rule < 0 || pos - states[state].depth <= match_start)
+				continue;
+		} else if (match_rule < 0)
+			break;
+		
+		sub = subs->rules->data + match_rule;
+		memcpy(out_p, text + copied, match_start - copied);
+		out_p += match_start - copied;
+		strcpy(out_p, sub->to);
+		out_p += strlen(sub->to);
+		/* Matches overlapping this one are dropped by reading again from
+			its end */
+		copied = pos = match_start + match_len;
+		state = 0;
+		match_rule = -1;
 	}
+	strcpy(out_p, text + copied);
 	return output;
 }
 
-void substitutions_destroy(Vector *substitutions) {
+void substitutions_destroy(Substitutions *substitutions) {
 	size_t pos = 0;
 	const Substitution *sub;
 	
-	while ((sub = vector_get_const(substitutions, pos++)) != NULL) {
+	while ((sub = substitution_vector_get(substitutions->rules, pos++))
+		!= NULL) {
 		free(sub->from);
 		free(sub->to);
 	}
-	vector_destroy(substitutions);
+	substitution_vector_destroy(substitutions->rules);
+	automaton_destroy(substitutions->automaton);
+	free(substitutions);
 }
 
 static char *postprocess_text(const char *text, int remove_whitespaces,
-	Vector *substitutions) {
+	Substitutions *substitutions) {
 	int i, j;
 	char *text2, *output;
 	
@@ -175,16 +911,39 @@ static char *postprocess_text(const char *text, int remove_whitespaces,
 	return output;
 }
 
-char *processPixbuf(GdkPixbuf *pixbuf, text_ori orientation,
-	int remove_whitespaces, TessBaseAPI *tess_handle, Vector *substitutions) {
-	PIX *img;
+char *processPixbuf(GdkPixbuf *pixbuf, const GdkRectangle *rect,
+	const recognize_Preprocess *preprocess, text_ori orientation,
+	int remove_whitespaces, TessBaseAPI *tess_handle,
+	Substitutions *substitutions, const recognize_Control *control,
+	recognize_Timing *timing, int *confidence) {
+	PIX *img, *preprocessed_img;
 	char *text, *processed_text;
+	recognize_Timing unused;
+	gint64 start;
+
+	if (timing == NULL)
+		timing = &unused;
+	memset(timing, 0, sizeof(*timing));
 
-	img = pixbuf_to_leptpix(pixbuf);
+	/* Tesseract binarizes the image anyway, so it is converted to grayscale
+		right away */
+	start = g_get_monotonic_time();
+	img = pixbuf_to_leptpix(pixbuf, rect, 1);
+	timing->convert = g_get_monotonic_time() - start;
 	if (img == NULL) {
 		fprintf(stderr, "Got invalid picture to process\n");
 		return NULL;
 	}
+	
+	if (preprocess != NULL && preprocess->enabled) {
+		if ((preprocessed_img = preprocess_image(img, preprocess, timing))
+			== NULL)
+			fprintf(stderr, "Could not preprocess picture, using it as is\n");
+		else {
+			pixDestroy(&img);
+			img = preprocessed_img;
+		}
+	}
 
 	switch (orientation) {
 	case TEXT_ORIENTATION_VERTICAL:
@@ -201,9 +960,20 @@ char *processPixbuf(GdkPixbuf *pixbuf, text_ori orientation,
 		break;
 	}
 
-	text = TesseractRecogize(img, tess_handle);
+	start = g_get_monotonic_time();
+	text = TesseractRecogize(img, tess_handle, control, confidence);
+	timing->recognize = g_get_monotonic_time() - start;
 	pixDestroy(&img);
+	g_debug("processPixbuf: convert %.1f ms, analyze %.1f ms, crop %.1f ms, "
+		"scale %.1f ms, binarize %.1f ms, recognize %.1f ms",
+		timing->convert / 1000.0, timing->analyze / 1000.0,
+		timing->crop / 1000.0, timing->scale / 1000.0,
+		timing->binarize / 1000.0, timing->recognize / 1000.0);
+	if (text == NULL)
+		return NULL;
+	start = g_get_monotonic_time();
 	processed_text = postprocess_text(text, remove_whitespaces, substitutions);
+	timing->postprocess = g_get_monotonic_time() - start;
 
 	TessDeleteText(text);
 	return processed_text;
@@ -19,6 +19,7 @@
 
 #pragma once
 
+#include <stdint.h>
 #include <gdk/gdk.h>
 #include <tesseract/capi.h>
 #include "vector.h"
@@ -29,14 +30,116 @@ typedef enum {
 	TEXT_ORIENTATION_HORIZONTAL
 } text_ori;
 
+typedef enum {
+	BINARIZE_NONE,
+	BINARIZE_OTSU,
+	BINARIZE_SAUVOLA
+} binarize_method;
+
+/** Settings for preparing a capture for recognition. If enabled, the capture
+	is cropped to its text if crop is set, scaled so that its glyphs are
+	about glyph_height pixels high, binarized and inverted if it has light
+	text on a dark background.
+*/
+typedef struct {
+	int enabled;
+	int crop;
+	int glyph_height;
+	binarize_method binarize;
+} recognize_Preprocess;
+
+#define RECOGNIZE_GLYPH_HEIGHT 36
+
+/* Microseconds spent on every stage of processing a capture */
+typedef struct {
+	gint64 convert;
+	gint64 analyze;
+	gint64 crop;
+	gint64 scale;
+	gint64 binarize;
+	gint64 recognize;
+	gint64 postprocess;
+} recognize_Timing;
+
+/** Lets a recognition be followed and stopped. cancelled and progress are
+	called with data on the thread that recognizes, either may be NULL.
+	Recognition stops if cancelled returns nonzero or after deadline
+	milliseconds unless deadline is 0. progress gets how much of the text is
+	recognized from 0 to 100.
+*/
+typedef struct {
+	int (*cancelled)(gpointer data);
+	void (*progress)(int progress, gpointer data);
+	gpointer data;
+	int deadline;
+} recognize_Control;
+
+/** Identifies a capture. exact is a hash of its grayscale pixels. width is
+	0 if the capture could not be read.
+*/
+typedef struct {
+	uint64_t exact;
+	int width;
+	int height;
+} recognize_Fingerprint;
+
 typedef struct {
 	char *from;
 	char *to;
 } Substitution;
 
-Vector *substitutions_load(const char *file_name);
-char *substitutions_apply(Vector *subs, const char *text);
-void substitutions_destroy(Vector *substitutions);
-char *processPixbuf(GdkPixbuf *pixbuf, text_ori orientation,
-                    int remove_whitespaces, TessBaseAPI *tess_handle,
-					Vector *substitutions);
+VECTOR_DEFINE(Substitution_vector, substitution_vector, Substitution)
+
+/** The rules of substitutions.txt together with an Aho-Corasick automaton
+	that finds all of them in one pass.
+*/
+typedef struct {
+	Substitution_vector *rules;
+	struct Substitution_automaton *automaton;
+} Substitutions;
+VECTOR_DEFINE(Rectangle_vector, rectangle_vector, GdkRectangle)
+
+/** Loads the rules "from=to" of file_name, one per line. Returns no rules if
+	file_name cannot be read.
+*/
+Substitutions *substitutions_load(const char *file_name);
+/** Returns a copy of text where the leftmost and then longest occurence of
+	the from of any rule is replaced with its to, continuing after it. Rules
+	are applied at once, so the text a rule puts in is not changed by
+	another. If several rules have the same from, the first is used.
+*/
+char *substitutions_apply(const Substitutions *subs, const char *text);
+void substitutions_destroy(Substitutions *substitutions);
+/** Splits the part rect of pixbuf, or all of pixbuf if rect is NULL, into
+	blocks of text that can be recognized on their own, like the balloons of
+	a manga page. The blocks are ordered as they are read with orientation.
+	Returns NULL if the capture is too small to be worth splitting or holds
+	only one block.
+*/
+Rectangle_vector *recognize_find_blocks(GdkPixbuf *pixbuf,
+	const GdkRectangle *rect, text_ori orientation);
+/** Sets fingerprint for the part rect of pixbuf, or all of pixbuf if rect is
+	NULL.
+*/
+void recognize_fingerprint(GdkPixbuf *pixbuf, const GdkRectangle *rect,
+	recognize_Fingerprint *fingerprint);
+/** Guesses the orientation of the text in the part rect of pixbuf, or in all
+	of pixbuf if rect is NULL, from the gaps between its lines. Returns
+	TEXT_ORIENTATION_AUTO if it is unclear.
+*/
+text_ori recognize_guess_orientation(GdkPixbuf *pixbuf,
+	const GdkRectangle *rect);
+/** Recognizes the text in the part rect of pixbuf or in all of pixbuf if rect
+	is NULL. If preprocess is not NULL, the capture is prepared as it says.
+	If control is not NULL, the recognition reports its progress to it and
+	can be stopped by it, in which case NULL is returned. If timing is not
+	NULL, it is set to the time every stage took. If confidence is not NULL,
+	it is set to Tesseract's mean confidence in the text from 0 to 100.
+*/
+char *processPixbuf(GdkPixbuf *pixbuf, const GdkRectangle *rect,
+                    const recognize_Preprocess *preprocess,
+                    text_ori orientation, int remove_whitespaces,
+                    TessBaseAPI *tess_handle,
+					Substitutions *substitutions,
+					const recognize_Control *control,
+					recognize_Timing *timing, int *confidence);
@@ -20,85 +20,147 @@
 #pragma once
 
 #include <stddef.h>
-
-typedef struct {
-	size_t size;
-	size_t length;
-	size_t capacity;
-	void *data;
-} Vector;
-
-/** Create a new vector.
-	size specifies the size in bytes of one element in the vector
-*/
-Vector *vector_create(size_t size);
-
-/** Frees all memory of vector.
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+/** Defines the vector type Name holding elements of Type together with its
+	functions, which are all prefixed with prefix:
+
+	Name *prefix_create(void)
+		Creates a new, empty vector.
+	void prefix_destroy(Name *vector)
+		Frees all memory of vector, but not the memory its elements point to.
+	size_t prefix_length(const Name *vector)
+		Returns the length of vector.
+	void prefix_reserve(Name *vector, size_t capacity)
+		Makes sure capacity elements fit into vector without reallocating.
+	Type *prefix_get(const Name *vector, size_t pos)
+		Returns a pointer to the element at pos of vector. The element may be
+		modified in place. The returned pointer becomes invalid upon calling a
+		function that adds elements to vector.
+		If pos is equal or greater than the vector's length, it returns NULL.
+	void prefix_set(Name *vector, size_t pos, Type data)
+		Sets the element at pos in vector to data.
+		pos must be less than the vector's length.
+	void prefix_append(Name *vector, Type data)
+		Adds data to the back of vector.
+	void prefix_append_n(Name *vector, const Type *data, size_t n)
+		Adds the n elements at data to the back of vector.
+	void prefix_insert(Name *vector, size_t pos, Type data)
+		Adds data at position pos to vector.
+		pos must be less or equal to the vector's length.
+	void prefix_remove(Name *vector, size_t pos)
+		Removes the element at pos from vector.
+		pos must be less than the vector's length.
+	void prefix_clear(Name *vector)
+		Removes all elements of vector.
+
+	The elements are accessible directly as vector->data[0] up to
+	vector->data[vector->length - 1].
 */
-void vector_destroy(Vector *vector);
-
-/** Returns the length of vector
-*/
-size_t vector_length(Vector *vector);
-
-/** Sets the element at pos in vector to data.
-	pos must be less than the vector's length.
-*/
-void vector_set(Vector *vector, size_t pos, const void *data);
-
-/** Copies data to the front of vector
-	Exactly size bytes (as specified by the vector_create call) are being copied
-	into the vector.
-*/
-void vector_push(Vector *vector, const void *data);
-
-/** Copies data to the back of vector.
-	Exactly size bytes (as specified by the vector_create call) are being copied
-	into the vector.
-*/
-void vector_append(Vector *vector, const void *data);
-
-/** Copies data to position pos in vector.
-	Exactly size bytes (as specified by the vector_create call) are being copied
-	into the vector.
-	pos must be less or equal to the vector's length.
-*/
-void vector_insert(Vector *vector, size_t pos, const void *data);
-
-/** Removes the element at pos from vector.
-	pos must be less than the vector's length.
-*/
-void vector_remove(Vector *vector, size_t pos);
-
-/** Removes all elements of vector.
-*/
-void vector_clear(Vector *vector);
-
-/** Returns the element at pos of vector. The return value must be freed.
-	If pos is equal or greater than the vector's length, it returns NULL.
-*/
-void *vector_get(Vector *vector, size_t pos);
-
-/** Returns the element at pos of vector. The return value is constant and must
-	not be freed. The returned pointer becomes invalid upon calling
-	vector_insert, vector_push or vector_append.
-	If pos is equal or greater than the vector's length, it returns NULL.
-*/
-const void *vector_get_const(Vector *vector, size_t pos);
-
-/**	Returns first occurence of element data in vector. If the element
-	could not be found, it returns the vector's length.
-	equals is a function that returns 0 on equality of both parameters. This is
-	used to find the element in the vector.
-*/
-size_t vector_find(Vector *vector, const void *data,
-	int (*equals)(const void*, const void*, size_t));
-
-/**	Returns first occurence from pos of element data in vector. If the element
-	could not be found, it returns the vector's length.
-	equals is a function that returns 0 on equality of both parameters. This is
-	used to find the element in the vector.
+#define VECTOR_DEFINE(Name, prefix, Type) \
+typedef struct { \
+	size_t length; \
+	size_t capacity; \
+	Type *data; \
+} Name; \
+\
+static inline Name *prefix##_create(void) { \
+	Name *vector; \
+	\
+	vector = malloc(sizeof(*vector)); \
+	vector->length = 0; \
+	vector->capacity = 16; \
+	vector->data = malloc(vector->capacity * sizeof(Type)); \
+	return vector; \
+} \
+\
+static inline void prefix##_destroy(Name *vector) { \
+	free(vector->data); \
+	free(vector); \
+} \
+\
+static inline size_t prefix##_length(const Name *vector) { \
+	return vector->length; \
+} \
+\
+static inline void prefix##_reserve(Name *vector, size_t capacity) { \
+	size_t new_capacity = vector->capacity; \
+	\
+	if (capacity <= vector->capacity) \
+		return; \
+	while (new_capacity < capacity) \
+		new_capacity *= 2; \
+	vector->capacity = new_capacity; \
+	vector->data = realloc(vector->data, new_capacity * sizeof(Type)); \
+} \
+\
+static inline Type *prefix##_get(const Name *vector, size_t pos) { \
+	if (pos >= vector->length) \
+		return NULL; \
+	return vector->data + pos; \
+} \
+\
+static inline void prefix##_set(Name *vector, size_t pos, Type data) { \
+	assert(pos < vector->length); \
+	vector->data[pos] = data; \
+} \
+\
+static inline void prefix##_append(Name *vector, Type data) { \
+	if (vector->length == vector->capacity) \
+		prefix##_reserve(vector, vector->length + 1); \
+	vector->data[vector->length++] = data; \
+} \
+\
+static inline void prefix##_append_n(Name *vector, const Type *data, \
+	size_t n) { \
+	\
+	prefix##_reserve(vector, vector->length + n); \
+	memcpy(vector->data + vector->length, data, n * sizeof(Type)); \
+	vector->length += n; \
+} \
+\
+static inline void prefix##_insert(Name *vector, size_t pos, Type data) { \
+	assert(pos <= vector->length); \
+	\
+	if (vector->length == vector->capacity) \
+		prefix##_reserve(vector, vector->length + 1); \
+	memmove(vector->data + pos + 1, vector->data + pos, \
+		(vector->length - pos) * sizeof(Type)); \
+	vector->data[pos] = data; \
+	vector->length++; \
+} \
+\
+static inline void prefix##_remove(Name *vector, size_t pos) { \
+	assert(pos < vector->length); \
+	\
+	memmove(vector->data + pos, vector->data + pos + 1, \
+		(vector->length - pos - 1) * sizeof(Type)); \
+	vector->length--; \
+} \
+\
+static inline void prefix##_clear(Name *vector) { \
+	vector->length = 0; \
+}
+
+/** Defines the function
+
+	size_t prefix_find(const Name *vector, size_t pos, Key key)
+
+	for a vector type defined by VECTOR_DEFINE. It returns the first occurence
+	from pos of key in vector. If key could not be found, it returns the
+	vector's length.
+	equals is a function int equals(const Type *element, Key key) that returns 0
+	if element matches key. It should be static inline so that the search can
+	be inlined.
 */
-size_t vector_find_at(Vector *vector, size_t pos, const void *data,
-	int (*equals)(const void*, const void*, size_t));
-	
+#define VECTOR_DEFINE_FIND(Name, prefix, Key, equals) \
+static inline size_t prefix##_find(const Name *vector, size_t pos, \
+	Key key) { \
+	\
+	for (; pos < vector->length; pos++) \
+		if (equals(vector->data + pos, key) == 0) \
+			break; \
+	return pos; \
+}
@@ -0,0 +1,156 @@
+/*
+ * Copyright 2017 sprin0
+ * 
+ * This file is part of JpnCap.
+ * 
+ * JpnCap is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * JpnCap is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with JpnCap.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../src/vector.h"
+#include "../src/hashmap.h"
+
+/* Compares the hash tables with the vector searches they replaced. Best of
+	RUNS runs of each operation is printed in milliseconds. */
+#define RUNS 10
+/* Ids of dictionary entries, each of which is seen twice, as when the
+	results of several variants of a word are merged */
+#define IDS 4096
+/* Words of deinflection variants, each of which is looked up twice */
+#define WORDS 1024
+#define WORD_LENGTH 12
+
+VECTOR_DEFINE(Id_vector, id_vector, unsigned int)
+
+static inline int id_equals(const unsigned int *element, unsigned int key) {
+	return *element != key;
+}
+
+VECTOR_DEFINE_FIND(Id_vector, id_vector, unsigned int, id_equals)
+
+HASHSET_DEFINE(Id_set, id_set, unsigned int, hashmap_hash_int,
+	HASHMAP_EQUALS_INT)
+
+VECTOR_DEFINE(Word_vector, word_vector, const char*)
+
+static inline int word_equals(const char *const *element, const char *key) {
+	return strcmp(*element, key);
+}
+
+VECTOR_DEFINE_FIND(Word_vector, word_vector, const char*, word_equals)
+
+HASHMAP_DEFINE(Word_map, word_map, const char*, size_t, hashmap_hash_string,
+	hashmap_equals_string)
+
+static unsigned int ids[2 * IDS];
+static char words[WORDS][WORD_LENGTH + 1];
+
+static double now_ms(void) {
+	struct timespec time;
+	
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return time.tv_sec * 1000.0 + time.tv_nsec / 1000000.0;
+}
+
+/* Keeps the compiler from dropping the work */
+static volatile long sink;
+
+static void bench_ids_vector(void) {
+	Id_vector *seen = id_vector_create();
+	long unique = 0;
+	size_t i;
+	
+	for (i = 0; i < 2 * IDS; i++)
+		if (id_vector_find(seen, 0, ids[i]) == id_vector_length(seen)) {
+			id_vector_append(seen, ids[i]);
+			unique++;
+		}
+	sink = unique;
+	id_vector_destroy(seen);
+}
+
+static void bench_ids_set(void) {
+	Id_set *seen = id_set_create();
+	long unique = 0;
+	size_t i;
+	
+	for (i = 0; i < 2 * IDS; i++)
+		unique += id_set_add(seen, ids[i]);
+	sink = unique;
+	id_set_destroy(seen);
+}
+
+static void bench_words_vector(void) {
+	Word_vector *variants = word_vector_create();
+	long found = 0;
+	size_t i;
+	
+	for (i = 0; i < 2 * WORDS; i++)
+		if (word_vector_find(variants, 0, words[i % WORDS])
+			== word_vector_length(variants))
+			word_vector_append(variants, words[i % WORDS]);
+		else
+			found++;
+	sink = found;
+	word_vector_destroy(variants);
+}
+
+static void bench_words_map(void) {
+	Word_map *variants = word_map_create();
+	long found = 0;
+	size_t i;
+	
+	for (i = 0; i < 2 * WORDS; i++)
+		found += !word_map_add(variants, words[i % WORDS], i);
+	sink = found;
+	word_map_destroy(variants);
+}
+
+static double best_of(void (*bench)(void)) {
+	double best = 0, start, time;
+	int i;
+	
+	for (i = 0; i < RUNS; i++) {
+		start = now_ms();
+		bench();
+		time = now_ms() - start;
+		if (i == 0 || time < best)
+			best = time;
+	}
+	return best;
+}
+
+int main(void) {
+	size_t i, j;
+	
+	srand(1);
+	for (i = 0; i < IDS; i++)
+		ids[i] = ids[IDS + i] = rand();
+	/* The words share a prefix like the variants of one word do */
+	for (i = 0; i < WORDS; i++) {
+		for (j = 0; j < WORD_LENGTH; j++)
+			words[i][j] = j < WORD_LENGTH / 2 ? 'a' : 'a' + rand() % 26;
+		words[i][WORD_LENGTH] = '\0';
+	}
+	
+	printf("deduplicating %d ids: vector %.3f ms, set %.3f ms\n", IDS,
+		best_of(bench_ids_vector), best_of(bench_ids_set));
+	printf("deduplicating %d words: vector %.3f ms, map %.3f ms\n", WORDS,
+		best_of(bench_words_vector), best_of(bench_words_map));
+	return 0;
+}
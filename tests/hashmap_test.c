@@ -0,0 +1,210 @@
+/*
+ * Copyright 2017 sprin0
+ * 
+ * This file is part of JpnCap.
+ * 
+ * JpnCap is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * JpnCap is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with JpnCap.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../src/hashmap.h"
+
+#define CHECK(condition) do { \
+	if (!(condition)) { \
+		fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, \
+			#condition); \
+		exit(1); \
+	} \
+} while (0)
+
+/* Keys below RANDOM_KEYS are used by the random operations */
+#define RANDOM_KEYS 1000
+#define RANDOM_STEPS 200000
+
+/* Hashes a key to itself, so that the slot of a key is known */
+static inline size_t hash_identity(uint64_t key) {
+	return (size_t)key;
+}
+
+/* Hashes many keys to the same few values, which makes long runs of
+	occupied slots */
+static inline size_t hash_clustered(uint64_t key) {
+	return (size_t)(key % 61);
+}
+
+HASHMAP_DEFINE(Identity_map, identity_map, uint64_t, int, hash_identity,
+	HASHMAP_EQUALS_INT)
+HASHMAP_DEFINE(Clustered_map, clustered_map, uint64_t, int, hash_clustered,
+	HASHMAP_EQUALS_INT)
+HASHMAP_DEFINE(String_map, string_map, const char*, int, hashmap_hash_string,
+	hashmap_equals_string)
+HASHSET_DEFINE(Int_set, int_set, uint64_t, hashmap_hash_int,
+	HASHMAP_EQUALS_INT)
+
+/** Runs of keys that wrap around from the last slot to the first must still
+	be found after removing keys from their middle.
+*/
+static void test_wrap_around(void) {
+	Identity_map *map = identity_map_create();
+	
+	/* The table starts with 16 slots, so all of these belong in slot 15 */
+	CHECK(map->capacity == 16);
+	CHECK(identity_map_set(map, 15, 1));
+	CHECK(identity_map_set(map, 31, 2));
+	CHECK(identity_map_set(map, 47, 3));
+	/* Belongs in slot 0, which 31 took, so it goes to slot 2 */
+	CHECK(identity_map_set(map, 16, 4));
+	CHECK(map->entries[15].key == 15 && map->entries[0].key == 31
+		&& map->entries[1].key == 47 && map->entries[2].key == 16);
+	
+	CHECK(identity_map_remove(map, 15));
+	CHECK(identity_map_get(map, 15) == NULL);
+	CHECK(*identity_map_get(map, 31) == 2);
+	CHECK(*identity_map_get(map, 47) == 3);
+	CHECK(*identity_map_get(map, 16) == 4);
+	/* 31 and 47 moved back over the end, 16 moved back to its own slot */
+	CHECK(map->entries[15].key == 31 && map->entries[0].key == 47
+		&& map->entries[1].key == 16 && map->entries[2].hash == 0);
+	
+	CHECK(identity_map_remove(map, 47));
+	CHECK(map->entries[0].key == 16 && map->entries[1].hash == 0);
+	CHECK(!identity_map_remove(map, 47));
+	CHECK(identity_map_length(map) == 2);
+	identity_map_destroy(map);
+}
+
+/** Removing a key must not move a following key in front of its own slot.
+*/
+static void test_remove_keeps_home(void) {
+	Identity_map *map = identity_map_create();
+	
+	identity_map_set(map, 3, 1);
+	identity_map_set(map, 19, 2);
+	identity_map_set(map, 5, 3);
+	/* 3 and 19 take slots 3 and 4, 5 its own slot 5, 35 has to go on to 6 */
+	identity_map_set(map, 35, 4);
+	CHECK(map->entries[6].key == 35);
+	
+	CHECK(identity_map_remove(map, 3));
+	/* 19 moves to slot 3, 5 stays in its own slot, 35 moves to slot 4 */
+	CHECK(map->entries[3].key == 19 && map->entries[4].key == 35
+		&& map->entries[5].key == 5 && map->entries[6].hash == 0);
+	CHECK(*identity_map_get(map, 19) == 2);
+	CHECK(*identity_map_get(map, 5) == 3);
+	CHECK(*identity_map_get(map, 35) == 4);
+	identity_map_destroy(map);
+}
+
+/** Growing the table keeps all entries and stays at most three quarters
+	full.
+*/
+static void test_grow(void) {
+	Int_set *set = int_set_create();
+	Int_set_entry *entry;
+	size_t pos = 0, count = 0;
+	uint64_t i;
+	
+	for (i = 0; i < 10000; i++) {
+		CHECK(int_set_add(set, i * 7));
+		CHECK(4 * int_set_length(set) <= 3 * set->capacity);
+	}
+	CHECK(!int_set_add(set, 7));
+	CHECK(int_set_length(set) == 10000);
+	for (i = 0; i < 10000; i++) {
+		CHECK(int_set_contains(set, i * 7));
+		CHECK(!int_set_contains(set, i * 7 + 1));
+	}
+	while ((entry = int_set_next(set, &pos)) != NULL) {
+		CHECK(entry->key % 7 == 0);
+		count++;
+	}
+	CHECK(count == 10000);
+	
+	int_set_clear(set);
+	CHECK(int_set_length(set) == 0 && !int_set_contains(set, 7));
+	int_set_destroy(set);
+}
+
+static void test_strings(void) {
+	String_map *map = string_map_create();
+	char key[] = "word";
+	
+	CHECK(string_map_set(map, "word", 1));
+	CHECK(!string_map_add(map, key, 2));
+	CHECK(*string_map_get(map, key) == 1);
+	CHECK(!string_map_set(map, key, 3));
+	CHECK(*string_map_get(map, "word") == 3);
+	CHECK(string_map_get(map, "wor") == NULL);
+	CHECK(string_map_remove(map, "word"));
+	CHECK(string_map_length(map) == 0);
+	string_map_destroy(map);
+}
+
+/** Random adds, sets and removes with clustered hashes must match a plain
+	array.
+*/
+static void test_random(void) {
+	Clustered_map *map = clustered_map_create();
+	int values[RANDOM_KEYS];
+	size_t length = 0, i;
+	uint64_t key;
+	int *value, step;
+	
+	srand(1);
+	for (i = 0; i < RANDOM_KEYS; i++)
+		values[i] = -1;
+	for (step = 0; step < RANDOM_STEPS; step++) {
+		key = rand() % RANDOM_KEYS;
+		switch (rand() % 3) {
+		case 0:
+			CHECK(clustered_map_set(map, key, step) == (values[key] < 0));
+			length += values[key] < 0;
+			values[key] = step;
+			break;
+		case 1:
+			CHECK(clustered_map_add(map, key, step) == (values[key] < 0));
+			if (values[key] < 0) {
+				values[key] = step;
+				length++;
+			}
+			break;
+		default:
+			CHECK(clustered_map_remove(map, key) == (values[key] >= 0));
+			length -= values[key] >= 0;
+			values[key] = -1;
+		}
+		CHECK(clustered_map_length(map) == length);
+		
+		if (step % 1000 != 0)
+			continue;
+		for (i = 0; i < RANDOM_KEYS; i++) {
+			value = clustered_map_get(map, i);
+			CHECK(values[i] < 0 ? value == NULL
+				: value != NULL && *value == values[i]);
+		}
+	}
+	clustered_map_destroy(map);
+}
+
+int main(void) {
+	test_wrap_around();
+	test_remove_keeps_home();
+	test_grow();
+	test_strings();
+	test_random();
+	return 0;
+}
@@ -0,0 +1,175 @@
+/*
+ * Copyright 2017 sprin0
+ * 
+ * This file is part of JpnCap.
+ * 
+ * JpnCap is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * JpnCap is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with JpnCap.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+/* The kernels are static, so they are compiled in here to be timed one by
+	one */
+#include "../src/pixel_convert.c"
+
+/* Converts a 4K frame with the scalar code and every kernel the processor
+	has. Best of RUNS runs is printed in milliseconds. */
+#define RUNS 10
+#define WIDTH_4K 3840
+#define HEIGHT_4K 2160
+
+typedef int (*Convert_kernel)(const unsigned char *, uint32_t *, int, int);
+typedef int (*Xrgb_kernel)(const uint32_t *, unsigned char *, int);
+typedef int (*Difference_kernel)(const unsigned char *, const unsigned char *,
+	int, uint64_t *);
+
+static unsigned char *frame, *other_frame;
+static uint32_t *pix;
+
+static double now_ms(void) {
+	struct timespec time;
+	
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return time.tv_sec * 1000.0 + time.tv_nsec / 1000000.0;
+}
+
+/* Keeps the compiler from dropping the work */
+static volatile uint64_t sink;
+
+/** Converts the frame row by row like recognize.c does, with kernel followed
+	by the scalar code for the rest of every row. kernel may be NULL to only
+	use the scalar code.
+*/
+static double bench_convert(Convert_kernel kernel, int gray, int n_channels) {
+	double best = 0, start, time;
+	const unsigned char *src;
+	uint32_t *dst;
+	int run, y, x, words_per_row;
+	
+	words_per_row = gray ? (WIDTH_4K + 3) / 4 : WIDTH_4K;
+	for (run = 0; run < RUNS; run++) {
+		start = now_ms();
+		for (y = 0; y < HEIGHT_4K; y++) {
+			src = frame + (size_t)y * WIDTH_4K * n_channels;
+			dst = pix + (size_t)y * words_per_row;
+			x = kernel != NULL ? kernel(src, dst, WIDTH_4K, n_channels) : 0;
+			if (gray)
+				convert_row_gray_scalar(src + x * n_channels, dst + x / 4,
+					WIDTH_4K - x, n_channels);
+			else
+				convert_row_rgb_scalar(src + x * n_channels, dst + x,
+					WIDTH_4K - x, n_channels);
+		}
+		time = now_ms() - start;
+		sink = pix[run];
+		if (run == 0 || time < best)
+			best = time;
+	}
+	return best;
+}
+
+/** Converts the frame as an X image to RGB like capture.c does.
+*/
+static double bench_xrgb(Xrgb_kernel kernel) {
+	double best = 0, start, time;
+	const uint32_t *src;
+	unsigned char *dst;
+	int run, y, x;
+	
+	for (run = 0; run < RUNS; run++) {
+		start = now_ms();
+		for (y = 0; y < HEIGHT_4K; y++) {
+			src = (const uint32_t*)frame + (size_t)y * WIDTH_4K;
+			dst = (unsigned char*)pix + (size_t)y * WIDTH_4K * 3;
+			x = kernel != NULL ? kernel(src, dst, WIDTH_4K) : 0;
+			convert_row_xrgb_scalar(src + x, dst + 3 * x, WIDTH_4K - x);
+		}
+		time = now_ms() - start;
+		sink = pix[run];
+		if (run == 0 || time < best)
+			best = time;
+	}
+	return best;
+}
+
+/** Compares the frame with another row by row like a watch does.
+*/
+static double bench_difference(Difference_kernel kernel) {
+	double best = 0, start, time;
+	size_t offset;
+	uint64_t sum, row_sum;
+	int run, y, i;
+	
+	for (run = 0; run < RUNS; run++) {
+		start = now_ms();
+		sum = 0;
+		for (y = 0; y < HEIGHT_4K; y++) {
+			offset = (size_t)y * WIDTH_4K * 4;
+			row_sum = 0;
+			i = kernel != NULL ? kernel(frame + offset, other_frame + offset,
+				WIDTH_4K * 4, &row_sum) : 0;
+			sum += row_sum + row_difference_scalar(frame + offset + i,
+				other_frame + offset + i, WIDTH_4K * 4 - i);
+		}
+		time = now_ms() - start;
+		sink = sum;
+		if (run == 0 || time < best)
+			best = time;
+	}
+	return best;
+}
+
+static void bench_kernels(const char *name, Convert_kernel rgb,
+	Convert_kernel gray, Xrgb_kernel xrgb, Difference_kernel difference) {
+	
+	printf("%s:\n", name);
+	printf("  RGB to 32 bpp %6.2f ms, RGBA to 32 bpp %6.2f ms\n",
+		bench_convert(rgb, 0, 3), bench_convert(rgb, 0, 4));
+	printf("  RGB to gray   %6.2f ms, RGBA to gray   %6.2f ms\n",
+		bench_convert(gray, 1, 3), bench_convert(gray, 1, 4));
+	printf("  X image to RGB %5.2f ms, difference     %6.2f ms\n",
+		bench_xrgb(xrgb), bench_difference(difference));
+}
+
+int main(void) {
+	size_t i, length = (size_t)WIDTH_4K * HEIGHT_4K * 4;
+	
+	frame = malloc(length);
+	other_frame = malloc(length);
+	pix = malloc((size_t)WIDTH_4K * HEIGHT_4K * sizeof(uint32_t));
+	srand(1);
+	for (i = 0; i < length; i++) {
+		frame[i] = rand();
+		other_frame[i] = frame[i] ^ (i % 61 == 0);
+	}
+	
+	printf("%dx%d frame, best of %d runs\n", WIDTH_4K, HEIGHT_4K, RUNS);
+	bench_kernels("scalar", NULL, NULL, NULL, NULL);
+#ifdef PIXEL_CONVERT_X86
+	if (cpu_level() >= CPU_SSSE3)
+		bench_kernels("SSSE3", convert_row_rgb_ssse3, convert_row_gray_ssse3,
+			convert_row_xrgb_ssse3, row_difference_sse2);
+	/* The X image conversion has no AVX2 kernel of its own */
+	if (cpu_level() >= CPU_AVX2)
+		bench_kernels("AVX2", convert_row_rgb_avx2, convert_row_gray_avx2,
+			convert_row_xrgb_ssse3, row_difference_avx2);
+#endif
+	
+	free(pix);
+	free(other_frame);
+	free(frame);
+	return 0;
+}
@@ -0,0 +1,238 @@
+/*
+ * Copyright 2017 sprin0
+ * 
+ * This file is part of JpnCap.
+ * 
+ * JpnCap is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * JpnCap is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with JpnCap.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* The kernels are static, so they are compiled in here to be compared with
+	the scalar code one by one */
+#include "../src/pixel_convert.c"
+
+#define CHECK(condition) do { \
+	if (!(condition)) { \
+		fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, \
+			#condition); \
+		exit(1); \
+	} \
+} while (0)
+
+/* Rows up to this width are tested with every width, besides a 4K row */
+#define WIDTH_MAX 100
+#define WIDTH_4K 3840
+#define HEIGHT_4K 2160
+
+typedef int (*Convert_kernel)(const unsigned char *, uint32_t *, int, int);
+typedef int (*Xrgb_kernel)(const uint32_t *, unsigned char *, int);
+typedef int (*Difference_kernel)(const unsigned char *, const unsigned char *,
+	int, uint64_t *);
+
+/** Returns length random bytes in a buffer of exactly that size, so that
+	reading past it is noticed by memory checkers.
+*/
+static unsigned char *random_bytes(size_t length) {
+	unsigned char *bytes = calloc(length > 0 ? length : 1, 1);
+	size_t i;
+	
+	for (i = 0; i < length; i++)
+		bytes[i] = rand() % 4 == 0 ? (rand() % 2) * 255 : rand() % 256;
+	return bytes;
+}
+
+/** Checks that kernel followed by the scalar code for the rest of the row
+	gives the same as the scalar code alone. gray tells whether kernel makes
+	8 bpp pixels.
+*/
+static void check_convert(Convert_kernel kernel, int gray, int width,
+	int n_channels) {
+	unsigned char *src = random_bytes((size_t)width * n_channels);
+	size_t words = gray ? (width + 3) / 4 : width;
+	uint32_t *expected = calloc(words + 1, sizeof(uint32_t));
+	uint32_t *actual = calloc(words + 1, sizeof(uint32_t));
+	int x;
+	
+	if (gray) {
+		convert_row_gray_scalar(src, expected, width, n_channels);
+		x = kernel(src, actual, width, n_channels);
+		CHECK(x % 4 == 0 && x <= width);
+		convert_row_gray_scalar(src + x * n_channels, actual + x / 4,
+			width - x, n_channels);
+	} else {
+		convert_row_rgb_scalar(src, expected, width, n_channels);
+		x = kernel(src, actual, width, n_channels);
+		CHECK(x <= width);
+		convert_row_rgb_scalar(src + x * n_channels, actual + x, width - x,
+			n_channels);
+	}
+	CHECK(memcmp(expected, actual, words * sizeof(uint32_t)) == 0);
+	/* Nothing is written after the row */
+	CHECK(actual[words] == 0);
+	free(actual);
+	free(expected);
+	free(src);
+}
+
+/** Checks an X image row like check_convert.
+*/
+static void check_xrgb(Xrgb_kernel kernel, int width) {
+	uint32_t *src = (uint32_t*)random_bytes((size_t)width * 4);
+	unsigned char *expected = calloc((size_t)width * 3 + 1, 1);
+	unsigned char *actual = calloc((size_t)width * 3 + 1, 1);
+	int x;
+	
+	convert_row_xrgb_scalar(src, expected, width);
+	x = kernel(src, actual, width);
+	CHECK(x >= 0 && x <= width);
+	convert_row_xrgb_scalar(src + x, actual + 3 * x, width - x);
+	CHECK(memcmp(expected, actual, (size_t)width * 3) == 0);
+	CHECK(actual[width * 3] == 0);
+	free(actual);
+	free(expected);
+	free(src);
+}
+
+/** Returns the difference of the rows a and b by kernel followed by the
+	scalar code for the rest of the rows, or by the public function if kernel
+	is NULL.
+*/
+static uint64_t difference(Difference_kernel kernel, const unsigned char *a,
+	const unsigned char *b, int length) {
+	uint64_t sum = 0;
+	int i;
+	
+	if (kernel == NULL)
+		return pixel_convert_row_difference(a, b, length);
+	i = kernel(a, b, length, &sum);
+	CHECK(i >= 0 && i <= length);
+	return sum + row_difference_scalar(a + i, b + i, length - i);
+}
+
+static void check_difference(Difference_kernel kernel, int length) {
+	unsigned char *a = random_bytes(length), *b = random_bytes(length);
+	
+	CHECK(difference(kernel, a, b, length)
+		== row_difference_scalar(a, b, length));
+	/* The rows of a watched area need not start at an aligned address */
+	if (length > 1)
+		CHECK(difference(kernel, a + 1, b, length - 1)
+			== row_difference_scalar(a + 1, b, length - 1));
+	free(b);
+	free(a);
+}
+
+/** Checks rows whose difference is known without the scalar code: equal
+	rows, and black against white in both orders, which gives the largest
+	sum every lane can reach.
+*/
+static void check_difference_known(Difference_kernel kernel, int length) {
+	unsigned char *black = calloc(length > 0 ? length : 1, 1);
+	unsigned char *white = malloc(length > 0 ? length : 1);
+	unsigned char *copy = malloc(length > 0 ? length : 1);
+	unsigned char *same = malloc(length > 0 ? length : 1);
+	int i;
+	
+	memset(white, 255, length);
+	for (i = 0; i < length; i++)
+		copy[i] = same[i] = i * 7;
+	CHECK(difference(kernel, copy, same, length) == 0);
+	CHECK(difference(kernel, black, white, length) == (uint64_t)length * 255);
+	CHECK(difference(kernel, white, black, length) == (uint64_t)length * 255);
+	free(same);
+	free(copy);
+	free(white);
+	free(black);
+}
+
+static void check_kernels(const char *name, Convert_kernel rgb,
+	Convert_kernel gray, Xrgb_kernel xrgb, Difference_kernel difference) {
+	int width, n_channels;
+	
+	for (width = 0; width <= WIDTH_MAX; width++) {
+		for (n_channels = 3; n_channels <= 4; n_channels++) {
+			check_convert(rgb, 0, width, n_channels);
+			check_convert(gray, 1, width, n_channels);
+		}
+		check_xrgb(xrgb, width);
+		check_difference(difference, width);
+		check_difference_known(difference, width);
+	}
+	for (n_channels = 3; n_channels <= 4; n_channels++) {
+		check_convert(rgb, 0, WIDTH_4K, n_channels);
+		check_convert(gray, 1, WIDTH_4K, n_channels);
+	}
+	check_xrgb(xrgb, WIDTH_4K);
+	check_difference(difference, WIDTH_4K * 4);
+	check_difference_known(difference, WIDTH_4K * 4);
+	/* A whole 4K frame, whose sum no longer fits in 32 bits */
+	check_difference_known(difference, WIDTH_4K * HEIGHT_4K * 4 + 5);
+	printf("%s kernels match the scalar code\n", name);
+}
+
+/** The public functions use whichever kernels the processor has.
+*/
+static void check_public(void) {
+	int width = WIDTH_4K + 7, length;
+	unsigned char *src = random_bytes(width * 4), *other, *xrgb_expected;
+	uint32_t *expected = malloc(width * sizeof(uint32_t));
+	uint32_t *actual = malloc(width * sizeof(uint32_t));
+	
+	convert_row_rgb_scalar(src, expected, width, 4);
+	pixel_convert_row_rgb(src, actual, width, 4);
+	CHECK(memcmp(expected, actual, width * sizeof(uint32_t)) == 0);
+	convert_row_gray_scalar(src, expected, width, 3);
+	pixel_convert_row_gray(src, actual, width, 3);
+	CHECK(memcmp(expected, actual, (width + 3) / 4 * sizeof(uint32_t)) == 0);
+	xrgb_expected = malloc(width * 3);
+	convert_row_xrgb_scalar((const uint32_t*)src, xrgb_expected, width);
+	pixel_convert_row_xrgb((const uint32_t*)src, (unsigned char*)actual,
+		width);
+	CHECK(memcmp(xrgb_expected, actual, width * 3) == 0);
+	free(xrgb_expected);
+	other = random_bytes(width * 4);
+	CHECK(pixel_convert_row_difference(src, other, width * 4)
+		== row_difference_scalar(src, other, width * 4));
+	free(other);
+	for (length = 0; length <= WIDTH_MAX; length++) {
+		check_difference(NULL, length);
+		check_difference_known(NULL, length);
+	}
+	check_difference_known(NULL, WIDTH_4K * HEIGHT_4K * 4 + 5);
+	free(actual);
+	free(expected);
+	free(src);
+}
+
+int main(void) {
+	srand(1);
+#ifdef PIXEL_CONVERT_X86
+	if (cpu_level() >= CPU_SSSE3)
+		check_kernels("SSSE3", convert_row_rgb_ssse3, convert_row_gray_ssse3,
+			convert_row_xrgb_ssse3, row_difference_sse2);
+	else
+		printf("SSSE3 is not supported, its kernels are not checked\n");
+	/* The X image conversion has no AVX2 kernel of its own */
+	if (cpu_level() >= CPU_AVX2)
+		check_kernels("AVX2", convert_row_rgb_avx2, convert_row_gray_avx2,
+			convert_row_xrgb_ssse3, row_difference_avx2);
+	else
+		printf("AVX2 is not supported, its kernels are not checked\n");
+#endif
+	check_public();
+	return 0;
+}
@@ -0,0 +1,199 @@
+/*
+ * Copyright 2017 sprin0
+ * 
+ * This file is part of JpnCap.
+ * 
+ * JpnCap is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * JpnCap is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with JpnCap.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../src/vector.h"
+
+/* Compares VECTOR_DEFINE with the void* Vector it replaced. Best of RUNS
+	runs of each operation is printed in milliseconds. */
+#define RUNS 10
+#define APPENDS 2000000
+#define FIND_LENGTH 2000
+
+VECTOR_DEFINE(Int_vector, int_vector, int)
+
+static inline int int_equals(const int *element, int key) {
+	return *element != key;
+}
+
+VECTOR_DEFINE_FIND(Int_vector, int_vector, int, int_equals)
+
+/* The old Vector as it was in vector.c. Its functions are not inlined, as
+	they were in their own translation unit. */
+typedef struct {
+	size_t size;
+	size_t length;
+	size_t capacity;
+	void *data;
+} Old_vector;
+
+static __attribute__((noinline)) Old_vector *old_vector_create(size_t size) {
+	Old_vector *vector;
+	
+	vector = malloc(sizeof(*vector));
+	vector->size = size;
+	vector->length = 0;
+	vector->capacity = 16;
+	vector->data = malloc(vector->capacity * vector->size);
+	return vector;
+}
+
+static __attribute__((noinline)) void old_vector_destroy(Old_vector *vector) {
+	free(vector->data);
+	free(vector);
+}
+
+static __attribute__((noinline)) size_t old_vector_length(
+	Old_vector *vector) {
+	
+	return vector->length;
+}
+
+static __attribute__((noinline)) void old_vector_insert(Old_vector *vector,
+	size_t pos, const void *data) {
+	
+	if (vector->length + 1 > vector->capacity) {
+		vector->capacity *= 2;
+		vector->data = realloc(vector->data,
+			vector->capacity * vector->size);
+	}
+	if (pos != vector->length)
+		memmove((char*)vector->data + (pos + 1) * vector->size,
+			(char*)vector->data + pos * vector->size,
+			(vector->length - pos) * vector->size);
+	memcpy((char*)vector->data + pos * vector->size, data, vector->size);
+	vector->length++;
+}
+
+static __attribute__((noinline)) void old_vector_append(Old_vector *vector,
+	const void *data) {
+	
+	old_vector_insert(vector, vector->length, data);
+}
+
+static __attribute__((noinline)) const void *old_vector_get_const(
+	Old_vector *vector, size_t pos) {
+	
+	if (pos >= vector->length)
+		return NULL;
+	return (char*)vector->data + pos * vector->size;
+}
+
+static __attribute__((noinline)) size_t old_vector_find_at(
+	Old_vector *vector, size_t pos, const void *data,
+	int (*equals)(const void*, const void*, size_t)) {
+	
+	size_t i;
+	
+	for (i = pos; i < vector->length; i++)
+		if (equals((char*)vector->data + i * vector->size, data, vector->size)
+			== 0)
+			break;
+	return i;
+}
+
+static double now_ms(void) {
+	struct timespec time;
+	
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return time.tv_sec * 1000.0 + time.tv_nsec / 1000000.0;
+}
+
+/* Keeps the compiler from dropping the work */
+static volatile long sink;
+
+static void bench_append_old(void) {
+	Old_vector *vector = old_vector_create(sizeof(int));
+	long sum = 0;
+	size_t i;
+	int value;
+	
+	for (value = 0; value < APPENDS; value++)
+		old_vector_append(vector, &value);
+	for (i = 0; i < old_vector_length(vector); i++)
+		sum += *(const int*)old_vector_get_const(vector, i);
+	sink = sum;
+	old_vector_destroy(vector);
+}
+
+static void bench_append_new(void) {
+	Int_vector *vector = int_vector_create();
+	long sum = 0;
+	size_t i;
+	int value;
+	
+	for (value = 0; value < APPENDS; value++)
+		int_vector_append(vector, value);
+	for (i = 0; i < int_vector_length(vector); i++)
+		sum += vector->data[i];
+	sink = sum;
+	int_vector_destroy(vector);
+}
+
+static void bench_find_old(void) {
+	Old_vector *vector = old_vector_create(sizeof(int));
+	long sum = 0;
+	int value;
+	
+	for (value = 0; value < FIND_LENGTH; value++)
+		old_vector_append(vector, &value);
+	for (value = 0; value < FIND_LENGTH; value++)
+		sum += old_vector_find_at(vector, 0, &value, memcmp);
+	sink = sum;
+	old_vector_destroy(vector);
+}
+
+static void bench_find_new(void) {
+	Int_vector *vector = int_vector_create();
+	long sum = 0;
+	int value;
+	
+	for (value = 0; value < FIND_LENGTH; value++)
+		int_vector_append(vector, value);
+	for (value = 0; value < FIND_LENGTH; value++)
+		sum += int_vector_find(vector, 0, value);
+	sink = sum;
+	int_vector_destroy(vector);
+}
+
+static double best_of(void (*bench)(void)) {
+	double best = 0, start, time;
+	int i;
+	
+	for (i = 0; i < RUNS; i++) {
+		start = now_ms();
+		bench();
+		time = now_ms() - start;
+		if (i == 0 || time < best)
+			best = time;
+	}
+	return best;
+}
+
+int main(void) {
+	printf("%d appends and iteration: old %.2f ms, new %.2f ms\n", APPENDS,
+		best_of(bench_append_old), best_of(bench_append_new));
+	printf("%d finds in %d ints: old %.2f ms, new %.2f ms\n", FIND_LENGTH,
+		FIND_LENGTH, best_of(bench_find_old), best_of(bench_find_new));
+	return 0;
+}